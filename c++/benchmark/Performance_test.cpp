@@ -2,10 +2,20 @@
 #include <memory>
 #include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <chrono>
+#include <random>
+#include <limits>
 #include "BinaryTreeRec.h"
+#include "BTree.h"
+#include "FrozenTree.h"
+#include "VebTree.h"
+#include "STree.h"
+#include "NodePool.h"
+#include "CompactTree.h"
+#include "Interleave.h"
 
 template <class T>
 int dummy(T& i){
@@ -14,12 +24,38 @@ int dummy(T& i){
 
 int sum;
 
+// a resource that measures the memory of std::map, with the same overhead estimate of BinaryTree::memory_usage()
+class measuring_resource : public std::pmr::memory_resource
+{
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		used += bytes + allocation_overhead(std::allocator<char>{}, bytes);
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+	{
+		used -= bytes + allocation_overhead(std::allocator<char>{}, bytes);
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {return this == &other;}
+	public:
+	std::size_t used = 0;
+};
+
+// a large value, to compare the compact tree with the values in the nodes and out of them
+struct big_value {
+	double data[32];
+	big_value(double x = 0) : data{x} {}
+	explicit operator int() const {return int(data[0]);}
+};
+
 int main(int arcv, char *argv[])
 {
 
 	
 	const int N1 = (arcv<2) ? 40000 : atoi(argv[1]); //size of the linked list tree
 	const int N2 = (arcv<3) ? 2000000 : atoi(argv[2]); //size of the faster trees
+	const int N3 = (arcv<4) ? 16000000 : atoi(argv[3]); //size of the trees on huge pages
 	std::srand(N2);
 	std::vector<double> container; //this will contain all the elements for the final sum
 
@@ -51,6 +87,84 @@ int main(int arcv, char *argv[])
 	auto end = std::chrono::high_resolution_clock::now();
 	auto total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
 	std::cout << " LINKED_LIST_TREE: " << total << "us, average = " << total/double(N1) << "us" << std::endl;
+
+	// the same ordered insertions, rebalanced automatically when the searches go too deep
+	BinaryTree<const int, double> auto_balanced_tree;
+	auto_balanced_tree.auto_balance(2);
+	begin = std::chrono::high_resolution_clock::now();
+	for(int i = 0; i<N1; i++)
+		auto_balanced_tree.insert(i,i);
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	const auto& counters = auto_balanced_tree.counters();
+	std::cout << " AUTO_BALANCED_TREE: insertions " << total << "us, " << counters.rebuilds << " rebuilds of "
+	          << counters.relinked_nodes << " nodes in " << std::chrono::duration_cast<std::chrono::microseconds>(counters.time).count() << "us" << std::endl;
+
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		sum += dummy(auto_balanced_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << " AUTO_BALANCED_TREE: " << total << "us, average = " << total/double(N1) << "us, "
+	          << counters.rebuilds << " rebuilds, max depth " << counters.max_depth << std::endl;
+
+	// the same ordered insertions with the red-black policy
+	BinaryTree<const int, double, default_less<const int>, balancing::red_black> red_black_tree;
+	for(int i = 0; i<N1; i++)
+		red_black_tree.insert(i,i);
+
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		sum += dummy(red_black_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << " RED_BLACK_TREE: " << total << "us, average = " << total/double(N1) << "us" << std::endl;
+
+	// and with the AVL policy
+	BinaryTree<const int, double, default_less<const int>, balancing::avl> avl_list_tree;
+	for(int i = 0; i<N1; i++)
+		avl_list_tree.insert(i,i);
+
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		sum += dummy(avl_list_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << " AVL_TREE: " << total << "us, average = " << total/double(N1) << "us" << std::endl;
+
+	// and with the scapegoat policy
+	BinaryTree<const int, double, default_less<const int>, balancing::scapegoat> scapegoat_tree;
+	for(int i = 0; i<N1; i++)
+		scapegoat_tree.insert(i,i);
+
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		sum += dummy(scapegoat_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << " SCAPEGOAT_TREE: " << total << "us, average = " << total/double(N1) << "us" << std::endl;
+
+	// and with the treap policy
+	BinaryTree<const int, double, default_less<const int>, balancing::treap> treap_tree;
+	for(int i = 0; i<N1; i++)
+		treap_tree.insert(i,i);
+
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		sum += dummy(treap_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << " TREAP_TREE: " << total << "us, average = " << total/double(N1) << "us" << std::endl;
 	
 
 
@@ -67,7 +181,11 @@ int main(int arcv, char *argv[])
 
 	BinaryTree<int, double> balanced_tree;
 	BinaryTree<int, double> random_tree;
-	std::map<int, double> map;
+	BinaryTree<int, double, default_less<int>, balancing::avl> avl_tree;
+	BTree<int, double> b_tree;
+	CompactTree<int, double> compact_tree;
+	measuring_resource map_memory;
+	std::pmr::map<int, double> map{&map_memory};
 
 	// initializing std map
 	std::cout << "initializing std::map  . . ." << std::endl;
@@ -81,11 +199,38 @@ int main(int arcv, char *argv[])
 		random_tree.insert(e,e + 0.1);
 	}
 
+	// initializing AVL tree
+	std::cout << "initializing AVL tree . . ." << std::endl;
+	for(auto e : random)
+	{
+		avl_tree.insert(e,e + 0.1);
+	}
+
+	// initializing B-tree
+	std::cout << "initializing B-tree . . ." << std::endl;
+	for(auto e : random)
+	{
+		b_tree.insert(e,e + 0.1);
+	}
+
+	// initializing compact tree
+	std::cout << "initializing compact tree . . ." << std::endl;
+	for(auto e : random)
+	{
+		compact_tree.insert(e,e + 0.1);
+	}
+
 	// balancing one of the trees
 	std::cout << "balancing tree . . ." << std::endl;
 	balanced_tree = random_tree;
 	balanced_tree.balance();
 
+	// and freezing it
+	std::cout << "freezing balanced tree (Eytzinger, van Emde Boas and S-tree layouts) . . ." << std::endl;
+	const FrozenTree<int, double> frozen_tree = balanced_tree.freeze();
+	const VebTree<int, double> veb_tree{balanced_tree.cbegin(), balanced_tree.cend()};
+	const STree<int, double> s_tree{balanced_tree.cbegin(), balanced_tree.cend()};
+
 
 
 	//////////// Performance measuring ////////////
@@ -104,7 +249,8 @@ int main(int arcv, char *argv[])
 	}
 	end = std::chrono::high_resolution_clock::now();
 	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
-	std::cout << "RANDOM_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+	std::cout << "RANDOM_TREE: " << total << "us, average = " << total/double(N2) << "us, "
+	          << random_tree.memory_usage().bytes_per_entry() << " bytes/entry" << std::endl;
 
 	//BALANCED TREE
 	begin = std::chrono::high_resolution_clock::now();
@@ -114,7 +260,68 @@ int main(int arcv, char *argv[])
 	}
 	end = std::chrono::high_resolution_clock::now();
 	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
-	std::cout << "BALANCED_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+	std::cout << "BALANCED_TREE: " << total << "us, average = " << total/double(N2) << "us, "
+	          << balanced_tree.memory_usage().bytes_per_entry() << " bytes/entry" << std::endl;
+
+	//FROZEN TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(frozen_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "FROZEN_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//VAN EMDE BOAS TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(veb_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "VEB_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//S-TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(s_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "S_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//AVL TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(avl_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "AVL_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//B-TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(b_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "B_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//COMPACT TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random)
+	{
+		sum += dummy(compact_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "COMPACT_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
 
 	//MAP
 	begin = std::chrono::high_resolution_clock::now();
@@ -124,7 +331,354 @@ int main(int arcv, char *argv[])
 	}
 	end = std::chrono::high_resolution_clock::now();
 	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
-	std::cout << "MAP: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+	std::cout << "MAP: " << total << "us, average = " << total/double(N2) << "us, "
+	          << map_memory.used/double(map.size()) << " bytes/entry" << std::endl;
+
+	// the same lookups resolved one at a time with find() and all together with find_batch()
+	std::cout << "looking up all the elements in a batch . . ." << std::endl;
+	{
+		const std::vector<int> batch(random.begin(), random.end());
+		auto one_by_one_vs_batch = [&](const char* name, auto& tree)
+		{
+			std::vector<decltype(tree.find(0))> results(batch.size(), tree.end());
+			begin = std::chrono::high_resolution_clock::now();
+			for(std::size_t i = 0; i < batch.size(); ++i)
+				results[i] = tree.find(batch[i]);
+			end = std::chrono::high_resolution_clock::now();
+			const auto single = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+			for(auto it : results)
+				sum += dummy((*it).second);
+			begin = std::chrono::high_resolution_clock::now();
+			tree.find_batch(batch, results.begin());
+			end = std::chrono::high_resolution_clock::now();
+			const auto batched = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+			for(auto it : results)
+				sum += dummy((*it).second);
+			std::cout << name << ": one at a time " << single << "us, " << batch.size()/double(single) << " M lookups/s, find_batch "
+			          << batched << "us, " << batch.size()/double(batched) << " M lookups/s" << std::endl;
+		};
+		one_by_one_vs_batch("BATCHED BALANCED_TREE", balanced_tree);
+		one_by_one_vs_batch("BATCHED FROZEN_TREE", frozen_tree);
+		one_by_one_vs_batch("BATCHED VEB_TREE", veb_tree);
+		one_by_one_vs_batch("BATCHED S_TREE", s_tree);
+	}
+
+	// the lookups of the balanced tree as coroutines, run in round-robin by schedulers of different widths
+	std::cout << "looking up all the elements in interleaved coroutines . . ." << std::endl;
+	{
+		const std::vector<int> batch(random.begin(), random.end());
+		std::vector<BinaryTree<int, double>::Iterator> results(batch.size(), balanced_tree.end());
+		begin = std::chrono::high_resolution_clock::now();
+		for(std::size_t i = 0; i < batch.size(); ++i)
+			results[i] = balanced_tree.find(batch[i]);
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		for(auto it : results)
+			sum += dummy((*it).second);
+		std::cout << "BALANCED_TREE (sequential): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+		for(std::size_t width : {4, 8, 16, 32})
+		{
+			interleave::scheduler lookups{width};
+			begin = std::chrono::high_resolution_clock::now();
+			for(std::size_t i = 0; i < batch.size(); ++i)
+				lookups.spawn(balanced_tree.co_find(batch[i], &results[i]));
+			lookups.run();
+			end = std::chrono::high_resolution_clock::now();
+			total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+			for(auto it : results)
+				sum += dummy((*it).second);
+			std::cout << "BALANCED_TREE (" << width << " coroutines): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+		}
+	}
+
+	// the same random tree built and destroyed with the default allocator and with a node pool
+	std::cout << "building and destroying the random tree with three allocators . . ." << std::endl;
+	{
+		begin = std::chrono::high_resolution_clock::now();
+		auto heap_tree = std::make_unique<BinaryTree<int, double>>();
+		for(auto e : random)
+			heap_tree->insert(e,e + 0.1);
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		begin = end;
+		heap_tree.reset();
+		end = std::chrono::high_resolution_clock::now();
+		std::cout << "NEW_DELETE: build " << total << "us, destroy "
+		          << std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count() << "us" << std::endl;
+
+		begin = std::chrono::high_resolution_clock::now();
+		auto pool = std::make_unique<node_pool>();
+		auto pool_tree = std::make_unique<pmr::BinaryTree<int, double>>(default_less<int>{}, balancing::none{}, pool.get());
+		for(auto e : random)
+			pool_tree->insert(e,e + 0.1);
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		begin = end;
+		pool_tree.reset();
+		pool.reset();
+		end = std::chrono::high_resolution_clock::now();
+		std::cout << "NODE_POOL: build " << total << "us, destroy "
+		          << std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count() << "us" << std::endl;
+
+		// the entries are trivially destructible, so the tree is dropped without visiting the nodes
+		begin = std::chrono::high_resolution_clock::now();
+		auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		auto arena_tree = std::make_unique<pmr::BinaryTree<int, double>>(default_less<int>{}, balancing::none{}, arena.get());
+		for(auto e : random)
+			arena_tree->insert(e,e + 0.1);
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		begin = end;
+		arena_tree.reset();
+		arena.reset();
+		end = std::chrono::high_resolution_clock::now();
+		std::cout << "ARENA: build " << total << "us, destroy "
+		          << std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count() << "us" << std::endl;
+	}
+
+	// the compact tree with 256-byte values, in the nodes and in a separate array
+	std::cout << "initializing compact trees with 256-byte values . . ." << std::endl;
+	{
+		CompactTree<int, big_value> inline_tree;
+		CompactTree<int, big_value, default_less<int>, true> split_tree;
+		inline_tree.reserve(N2);
+		split_tree.reserve(N2);
+		for(auto e : random)
+		{
+			inline_tree.insert(e,e + 0.1);
+			split_tree.insert(e,e + 0.1);
+		}
+		std::random_shuffle ( random.begin(), random.end());
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(auto e : random)
+		{
+			sum += dummy(inline_tree[e]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "COMPACT_TREE (values in the nodes): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(auto e : random)
+		{
+			sum += dummy(split_tree[e]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "COMPACT_TREE (values apart): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+	}
+
+	// the balanced tree relinked in place, and then moved in pre-order and in breadth-first order
+	std::cout << "compacting a copy of the balanced tree . . ." << std::endl;
+	{
+		BinaryTree<int, double> relaid_tree{random_tree};
+		relaid_tree.balance();
+		using order = BinaryTree<int, double>::order;
+		for(int layout = 0; layout < 3; layout++)
+		{
+			if(layout > 0)
+				relaid_tree.compact(layout == 1 ? order::pre_order : order::breadth_first);
+			begin = std::chrono::high_resolution_clock::now();
+			for(auto e : random)
+			{
+				sum += dummy(relaid_tree[e]);
+			}
+			end = std::chrono::high_resolution_clock::now();
+			total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+			begin = end;
+			for(const auto& e : relaid_tree)
+				sum += dummy(e.second);
+			end = std::chrono::high_resolution_clock::now();
+			std::cout << (layout == 0 ? "RELINKED" : layout == 1 ? "PRE_ORDER" : "BREADTH_FIRST") << ": " << total
+			          << "us, average = " << total/double(N2) << "us, in-order scan "
+			          << std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count() << "us" << std::endl;
+		}
+	}
+
+	// int keys in two trees of the same shape, compared through a function pointer or by the default function object;
+	// the best of three rounds, alternated so that both see the same state of the machine
+	std::cout << "building trees with int keys and the two comparing functions . . ." << std::endl;
+	{
+		BinaryTree<int, double, decltype(&default_comparator<int>)> pointer_tree{balanced_tree.cbegin(), balanced_tree.cend()};
+		BinaryTree<int, double> functor_tree{balanced_tree.cbegin(), balanced_tree.cend()};
+		const std::vector<int> keys(random.begin(), random.end());
+		long best_pointer = std::numeric_limits<long>::max(), best_functor = std::numeric_limits<long>::max();
+		for(int round = 0; round < 3; ++round)
+		{
+			begin = std::chrono::high_resolution_clock::now();
+			for(auto k : keys)
+				sum += dummy(pointer_tree[k]);
+			end = std::chrono::high_resolution_clock::now();
+			best_pointer = std::min<long>(best_pointer, std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count());
+			begin = std::chrono::high_resolution_clock::now();
+			for(auto k : keys)
+				sum += dummy(functor_tree[k]);
+			end = std::chrono::high_resolution_clock::now();
+			best_functor = std::min<long>(best_functor, std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count());
+		}
+		std::cout << "INT_KEYS (function pointer): " << best_pointer << "us, average = " << best_pointer/double(N2) << "us" << std::endl;
+		std::cout << "INT_KEYS (three-way default_less): " << best_functor << "us, average = " << best_functor/double(N2) << "us" << std::endl;
+	}
+
+	// string keys with a long common prefix, compared through a function pointer or by the default function object
+	std::cout << "initializing trees with string keys . . ." << std::endl;
+	{
+		std::vector<std::string> words;
+		for(auto e : random)
+		{
+			std::string digits = std::to_string(int(e));
+			words.push_back("/accounts/customers/" + std::string(10 - digits.size(), '0') + digits);
+		}
+		BinaryTree<std::string, double, decltype(&default_comparator<std::string>)> pointer_tree;
+		BinaryTree<std::string, double> functor_tree;
+		for(const auto& w : words)
+		{
+			pointer_tree.insert(w, 0.1);
+			functor_tree.insert(w, 0.1);
+		}
+		std::random_shuffle ( words.begin(), words.end());
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(const auto& w : words)
+		{
+			sum += dummy(pointer_tree[w]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "STRING_KEYS (function pointer): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(const auto& w : words)
+		{
+			sum += dummy(functor_tree[w]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "STRING_KEYS (three-way default_less): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+		// the same keys queried as views in a buffer: a std::string is built for every lookup, unless the
+		// comparing function is transparent
+		BinaryTree<std::string, double, default_less<>> transparent_tree;
+		for(const auto& w : words)
+			transparent_tree.insert(w, 0.1);
+		std::string buffer;
+		for(const auto& w : words)
+			buffer += w;
+		std::vector<std::string_view> views;
+		for(std::size_t i = 0; i < words.size(); ++i)
+			views.emplace_back(buffer.data() + i*words[0].size(), words[0].size());
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(auto v : views)
+		{
+			sum += dummy((*functor_tree.find(std::string{v})).second);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "STRING_VIEWS (key built): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+		begin = std::chrono::high_resolution_clock::now();
+		for(auto v : views)
+		{
+			sum += dummy((*transparent_tree.find(v)).second);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << "STRING_VIEWS (transparent): " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+	}
+
+	// the random tree cleared and filled again, giving back its nodes every time or recycling them
+	std::cout << "clearing and filling the random tree . . ." << std::endl;
+	for(bool recycled : {false, true})
+	{
+		BinaryTree<int, double> refilled_tree;
+		if(recycled) refilled_tree.reserve(N2);
+		begin = std::chrono::high_resolution_clock::now();
+		for(int round = 0; round < 3; round++)
+		{
+			refilled_tree.clear();
+			for(auto e : random)
+				refilled_tree.insert(e,e + 0.1);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+		std::cout << (recycled ? "RECYCLED" : "NOT_RECYCLED") << ": 3 rounds " << total << "us, hit rate = "
+		          << refilled_tree.recycling().hit_rate() << std::endl;
+	}
+
+	//PART 3
+
+	std::cout << "\nBENCHMARK PART 3\nzipf distributed accesses, tree size = "<< N2 << std::endl;
+
+	// the i-th most accessed key is random[i], with probability proportional to 1/(i+1)
+	std::vector<double> weights;
+	for(int i = 0; i<N2; i++)
+		weights.push_back(1.0/(i + 1));
+	std::mt19937 generator(N2);
+	std::discrete_distribution<int> zipf(weights.begin(), weights.end());
+	std::vector<int> zipf_accesses;
+	for(int i = 0; i<N2; i++)
+		zipf_accesses.push_back(random[zipf(generator)]);
+
+	BinaryTree<int, double, default_less<int>, balancing::splay> splay_tree;
+	std::cout << "initializing splay tree . . ." << std::endl;
+	for(auto e : random)
+	{
+		splay_tree.insert(e,e + 0.1);
+	}
+
+	std::cout << "accessing the elements . . ." << std::endl;
+
+	//BALANCED TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : zipf_accesses)
+	{
+		sum += dummy(balanced_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "BALANCED_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//SPLAY TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : zipf_accesses)
+	{
+		sum += dummy(splay_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "SPLAY_TREE: " << total << "us, average = " << total/double(N2) << "us" << std::endl;
+
+	//PART 4
+
+	std::cout << "\nBENCHMARK PART 4\nhuge pages, tree size = "<< N3 << std::endl;
+	{
+		std::vector<std::pair<int, double>> sorted;
+		for(int i = 0; i<N3; i++)
+			sorted.emplace_back(i, i + 0.1);
+		std::vector<int> lookups;
+		std::uniform_int_distribution<int> uniform(0, N3 - 1);
+		for(int i = 0; i<N2; i++)
+			lookups.push_back(uniform(generator));
+
+		// the same balanced tree in a pool on normal pages and in one on huge pages
+		huge_page_resource huge;
+		for(bool on_huge_pages : {false, true})
+		{
+			std::cout << "building balanced tree " << (on_huge_pages ? "on huge pages" : "on normal pages") << " . . ." << std::endl;
+			node_pool pool{1 << 16, 1 << 20, on_huge_pages ? &huge : std::pmr::get_default_resource()};
+			pmr::BinaryTree<int, double> big_tree{sorted.begin(), sorted.end(), default_less<int>{}, balancing::none{}, &pool};
+			begin = std::chrono::high_resolution_clock::now();
+			for(auto e : lookups)
+			{
+				sum += dummy(big_tree[e]);
+			}
+			end = std::chrono::high_resolution_clock::now();
+			total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+			std::cout << (on_huge_pages ? "HUGE_PAGES: " : "NORMAL_PAGES: ") << total << "us, average = " << total/double(N2) << "us" << std::endl;
+		}
+	}
 
 	std::cout << "\"sum\" is: " << sum << std::endl;
 	
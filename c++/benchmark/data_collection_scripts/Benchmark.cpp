@@ -5,7 +5,8 @@
 #include <vector>
 #include <map>
 #include <chrono>
-#include "../BinaryTreeRec.h"
+#include "../../include/BinaryTreeRec.h"
+#include "../../include/VebTree.h"
 #include <fstream>
 
 int main(int arcv, char *argv[])
@@ -63,6 +64,9 @@ int main(int arcv, char *argv[])
 	
 	const BinaryTree<const int, double> &t = balanced_tree;
 	balanced_tree[2] = 12;
+
+	// van Emde Boas snapshot of the balanced tree
+	const VebTree<int, double> veb_tree{balanced_tree.cbegin(), balanced_tree.cend()};
 	
 
 	
@@ -126,7 +130,17 @@ int main(int arcv, char *argv[])
 	}
 	end = std::chrono::high_resolution_clock::now();
 	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
-	std::cout << "MAP: " << total/double(N) << ";" << std::endl;
+	std::cout << "MAP: " << total/double(N) << ";";
+
+	//VAN EMDE BOAS TREE
+	begin = std::chrono::high_resolution_clock::now();
+	for(auto e : random_permutation_vector)
+	{
+		container.push_back(veb_tree[e]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	total = std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count();
+	std::cout << "VEB: " << total/double(N) << ";" << std::endl;
 
 	double s{0};
 	for(double x: container)
@@ -1,14 +1,19 @@
 #N_SEQ="1 2 4 6 8 10 12 14 16 18 20"
 N_SEQ="10000 20000 40000 60000 80000 100000 120000 140000 160000"
+# beyond 10M the trees do not fit in the last level cache of any of our machines
+N_SEQ_LARGE="12000000 16000000 20000000"
 BNAME=bench.x
 FIRST=1
 LAST=10
 
-echo "N;RANDOM;BALANCED;STD_MAP"
+echo "N;RANDOM;BALANCED;STD_MAP;VEB"
 for i in $(seq $FIRST $LAST); do
 	for i in $N_SEQ; do       
         	N=$((i*1))
 		./$BNAME $N ciao
 	done
+	for i in $N_SEQ_LARGE; do
+		./$BNAME $i ciao
+	done
 done
 exit
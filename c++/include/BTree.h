@@ -0,0 +1,784 @@
+/**
+ * @file BTree.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief B+ tree with the same interface of BinaryTree
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __BTREE__
+#define __BTREE__
+
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <new>
+#include <memory>
+#include <cstddef>
+#include "BinaryTreeRec.h"
+
+/**
+ * @brief Class that implements a B+ tree with the same interface of BinaryTree
+ *
+ * Every node fills about NodeBytes bytes instead of holding a single entry: the leaves contain the sorted
+ * entries and are linked in a list (used by the iterators), the inner nodes contain the separator keys and
+ * the pointers to their children. A lookup reads one node per level and there are only about log_B(n) levels,
+ * where B is the number of keys that fit in a node. All the leaves are at the same depth, so the tree is always balanced.
+ *
+ * Unlike BinaryTree, an insertion can move the entries inside the leaves, so it invalidates the iterators.
+ *
+ * @tparam K the key type, it must be default constructible and copy assignable since the keys are copied in the inner nodes,
+ * and its move assignment must not throw
+ * @tparam V the value stored in the leaves
+ * @tparam F the comparing function (default <)
+ * @tparam NodeBytes the size of a node in bytes (default 256, four cache lines)
+ */
+template <class K, class V, class F = ::default_less<K>, std::size_t NodeBytes = 256>
+class BTree
+{
+    /** the pair with key and value */
+    using entry_type = std::pair<const K, V>;
+    /** the type of the separator keys, copied in the inner nodes */
+    using key_type = typename std::remove_const<K>::type;
+    static_assert(std::is_nothrow_move_assignable<key_type>::value, "the separator keys are moved while the inner nodes are split");
+    /** if the entries can be moved without exceptions, otherwise a leaf is changed by copying it in a new one */
+    static constexpr bool nothrow_entries = std::is_nothrow_move_constructible<entry_type>::value;
+
+    /** the number of entries in a leaf */
+    static constexpr std::size_t leaf_capacity = std::max<std::size_t>(4, (NodeBytes - 2*sizeof(void*))/sizeof(entry_type));
+    /** the number of keys in an inner node */
+    static constexpr std::size_t inner_capacity = std::max<std::size_t>(4, (NodeBytes - 2*sizeof(void*))/(sizeof(key_type) + sizeof(void*)));
+    /** more levels than any tree that fits in memory, since every node has at least 3 children */
+    static constexpr std::size_t max_levels = 64;
+
+    /**
+     * @brief A leaf of the tree
+     * A private container with the sorted entries and a pointer to the next leaf. The entries are
+     * constructed in place in a raw storage, since std::pair<const K, V> cannot be assigned.
+     */
+    struct alignas(64) Leaf
+    {
+        /** number of entries */
+        std::size_t count = 0;
+        /** the leaf on the right, null for the last one */
+        Leaf* next = nullptr;
+        /** the space for the entries */
+        alignas(entry_type) unsigned char storage[leaf_capacity*sizeof(entry_type)];
+        /** the address of the i-th entry */
+        void* slot(std::size_t i) noexcept {return storage + i*sizeof(entry_type);}
+        /** the i-th entry */
+        entry_type& entry(std::size_t i) noexcept {return *std::launder(reinterpret_cast<entry_type*>(slot(i)));}
+        /** the i-th entry */
+        const entry_type& entry(std::size_t i) const noexcept {return *std::launder(reinterpret_cast<const entry_type*>(storage + i*sizeof(entry_type)));}
+    };
+
+    /**
+     * @brief An inner node of the tree
+     * The child i contains the keys between keys[i-1] (included) and keys[i] (excluded).
+     */
+    struct alignas(64) Inner
+    {
+        /** number of keys, the children are one more */
+        std::size_t count = 0;
+        /** the separator keys */
+        key_type keys[inner_capacity];
+        /** the children, leaves or inner nodes depending on the level */
+        void* children[inner_capacity + 1];
+    };
+
+    /** the root, a leaf if the tree has only one level */
+    void* root = nullptr;
+    /** number of levels, 0 for an empty tree */
+    std::size_t levels = 0;
+    /** number of entries in the tree */
+    std::size_t tree_size = 0;
+    /** The comparison operator, a functional object that returns a boolean */
+    F cmp;
+
+    /**
+     * @brief Finds the leaf that contains (or should contain) a key
+     *
+     * @param key the key to be searched
+     * @return Leaf* the leaf, null if the tree is empty
+     */
+    Leaf* find_leaf(const K& key) const;
+    /**
+     * @brief The position of the first entry of a leaf whose key is not less than the given one
+     */
+    std::size_t leaf_position(const Leaf* leaf, const K& key) const;
+    /**
+     * @brief The position of the child of an inner node that contains the given key
+     */
+    std::size_t child_position(const Inner* inner, const K& key) const;
+    /**
+     * @brief A function to calculate the first leaf
+     * @return Leaf* a pointer to the leftmost leaf
+     */
+    Leaf* first_leaf() const noexcept;
+    /**
+     * @brief Inserts an entry in a leaf that is not full, moving the following ones to the right
+     * Only for entries that are moved without exceptions, a throw would leave a hole in the leaf.
+     */
+    static void insert_entry(Leaf* leaf, std::size_t i, entry_type&& entry) noexcept;
+    /**
+     * @brief Copies a part of the entries of a leaf, with a new one among them, in an empty leaf
+     * If a copy throws, the ones already made are destroyed and the target is left empty.
+     * @param leaf the source
+     * @param i the position of the new entry
+     * @param entry the new entry
+     * @param from the first position to copy, counting the new entry
+     * @param to the position after the last one to copy
+     * @param target the empty leaf
+     */
+    static void copy_entries(const Leaf* leaf, std::size_t i, const entry_type& entry, std::size_t from, std::size_t to, Leaf* target);
+    /**
+     * @brief Puts a leaf in the place of another one, in its father and in the list, and destroys the old one
+     * @param old the leaf to be replaced
+     * @param fresh the new leaf, its next must be already set
+     * @param path the inner nodes from the root to the leaf
+     * @param positions the child taken in each of them
+     */
+    void replace_leaf(Leaf* old, Leaf* fresh, Inner* const* path, const std::size_t* positions) noexcept;
+    /**
+     * @brief Inserts a separator and the child on its right in an inner node that is not full
+     */
+    static void insert_child(Inner* inner, std::size_t i, key_type&& key, void* child) noexcept;
+    /**
+     * @brief Recursively destroys a subtree
+     * @param node the root of the subtree
+     * @param level the level of the node (0 for the root)
+     */
+    void destroy(void* node, std::size_t level) const noexcept;
+    /**
+     * @brief An utility for the copy constructor
+     * It recursively copies a subtree, linking the copied leaves one after the other.
+     * @param node the root of the subtree to be copied
+     * @param level the level of the node (0 for the root)
+     * @param last the last copied leaf
+     * @return void* the copy
+     */
+    void* copy_util(const void* node, std::size_t level, Leaf*& last) const;
+
+    public:
+
+    /**
+     * @brief Construct a new BTree object
+     */
+    BTree(F f = ::make_default_comparator<F,K>()): cmp{f} {};
+    /**
+     * @brief Destroy the BTree object
+     */
+    ~BTree() noexcept {clear();}
+    /**
+     * @brief Creates a deep copy of a B-tree
+     *
+     * @param bt the tree to be copied
+     */
+    BTree(const BTree& bt) : levels{bt.levels}, tree_size{bt.tree_size}, cmp{bt.cmp}
+    {
+        Leaf* last = nullptr;
+        if(bt.root != nullptr) root = copy_util(bt.root, 0, last);
+    }
+    /**
+     * @brief Copy assignement
+     *
+     * @param bt the tree to be copied
+     * @return BTree&
+     */
+    BTree& operator=(const BTree& bt);
+    /**
+     * @brief Move constructor, the moved tree is left empty
+     *
+     * @param bt the tree to be moved
+     */
+    BTree(BTree&& bt) noexcept : root{bt.root}, levels{bt.levels}, tree_size{bt.tree_size}, cmp{std::move(bt.cmp)}
+    {
+        bt.root = nullptr;
+        bt.levels = 0;
+        bt.tree_size = 0;
+    }
+    /**
+     * @brief Move assignment, the moved tree is left empty
+     *
+     * @param bt the tree to be moved
+     * @return BTree&
+     */
+    BTree& operator=(BTree&& bt) noexcept;
+
+    //clear the content of the tree
+    void clear() noexcept;
+
+    /**
+     * @brief The number of elements in the tree
+     *
+     * @return std::size_t the number of entries
+     */
+    std::size_t size() const noexcept {return tree_size;}
+
+    /**
+     * @brief Does nothing, a B-tree is always balanced
+     * It is here so that a BTree can replace a BinaryTree.
+     */
+    void balance() noexcept {}
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * If the key is not present, a new pair with the given key and a default value will be inserted in the tree.
+    *
+    * @tparam const K& the key of the searched value
+    * @return V& reference to the value
+    */
+    V& operator[](const K& key);
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * @throws runtime_errors if the key is not present
+    * @tparam const K& the key of the searched value
+    * @return const V& reference to the value
+    */
+    const V& operator[](const K& key) const;
+
+    class Iterator;
+    class ConstIterator;
+
+    /**
+    * @brief a function that return an Iterator to the first element
+    * @return Iterator iterator to the first element
+    */
+    Iterator begin() {return Iterator{first_leaf()};}
+    /**
+    * @brief A function that return an Iterator to one past the last element
+    * @return Iterator iterator to the end
+    */
+    Iterator end() {return Iterator{nullptr};}
+    /**
+     * @brief A constant iterator version of begin()
+     * @return ConstIterator constant iterator to the first element
+     */
+    ConstIterator begin() const {return ConstIterator{first_leaf()};}
+    /**
+     * @brief A constant interator version of end()
+     * @return ConstIterator returns a constant iterator to the end of the Data Structure
+     */
+    ConstIterator end() const {return ConstIterator{nullptr};}
+    /**
+     * @brief Same as ConstIterator begin() but explicit
+     * @return ConstIterator constant iterator to the first element
+     */
+    ConstIterator cbegin() const {return ConstIterator{first_leaf()};}
+    /**
+     * @brief Same as ConstIterator end() but explicit
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator cend() const {return ConstIterator{nullptr};}
+
+    /**
+     * @brief Finds a value with a given key and returns an iterator to it
+     * @param key the key to be searched
+     * @return Iterator an Iterator to the entry with the key or to end() if its not present
+     */
+    Iterator find(const K& key);
+    /**
+     * @brief Constant version of find()
+     * @param key the key to be searched
+     * @return ConstIterator a ConstIterator to the entry with the key or to end() if its not present
+     */
+    ConstIterator find(const K& key) const;
+
+    /**
+     * @brief Insert a new entry with given key and value
+     * It returns a std::pair with an iterator to the entry and a bool, true if the key was not present.
+     * The leaves are split when they are full, and so are the inner nodes up to the root.
+     * @param key the key of the new entry
+     * @param value the value of the new entry
+     * @return std::pair<Iterator,bool> a pair with an iterator to the inserted (or already present) entry and a bool that indicates if it has been added
+     */
+    std::pair<Iterator,bool> insert(const K& key, const V& value);
+    /**
+     * @brief An insert which takes directly an std::pair with the right types
+     *
+     * @param p the std::pair to be added
+     * @return std::pair<Iterator,bool> same as the other insert()
+     */
+    std::pair<Iterator,bool> insert(std::pair<const K&, const V&> p) {return insert(p.first,p.second);}
+
+    template <class k, class v, class f, std::size_t n>
+    /**
+     * @brief Overloading of the operator<< for printing and writing on files
+     *
+     * @return std::ostream&
+     */
+    friend std::ostream& operator<<(std::ostream&, const BTree<k,v,f,n>&);
+};
+
+template <class K, class V, class F, std::size_t NodeBytes>
+class BTree<K,V,F,NodeBytes>::Iterator
+{
+    /** the leaf of the pointed entry, null at the end */
+    Leaf* leaf;
+    /** the position of the entry in the leaf */
+    std::size_t index;
+
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    Iterator(Leaf* l, std::size_t i = 0) : leaf{l}, index{i} {}
+    Iterator(const Iterator&) = default;
+    std::pair<const K, V>& operator*() const {return leaf->entry(index);}
+
+    Iterator& operator++()
+    {
+        // at the end of a leaf go to the next one
+        if(++index == leaf->count)
+        {
+            leaf = leaf->next;
+            index = 0;
+        }
+        return *this;
+    }
+    Iterator operator++(int)
+    {
+        Iterator it{*this};
+        ++(*this);
+        return it;
+    }
+    bool operator==(const Iterator& other) const noexcept {return leaf == other.leaf && index == other.index;}
+    bool operator!=(const Iterator& other) const noexcept {return !(*this == other);}
+};
+
+template <class K, class V, class F, std::size_t NodeBytes>
+class BTree<K,V,F,NodeBytes>::ConstIterator : public BTree<K,V,F,NodeBytes>::Iterator
+{
+    public:
+        using non_const_it = BTree<K,V,F,NodeBytes>::Iterator;
+        using non_const_it::Iterator;
+        const std::pair<const K, V>& operator*() const {return non_const_it::operator*();}
+};
+
+template <class K, class V, class F, std::size_t NodeBytes>
+std::size_t BTree<K,V,F,NodeBytes>::leaf_position(const Leaf* leaf, const K& key) const
+{
+    std::size_t i = 0;
+    std::size_t n = leaf->count;
+    // binary search of the first entry not less than the key
+    while(n > 0)
+    {
+        std::size_t half = n/2;
+        if(cmp(leaf->entry(i + half).first, key))
+        {
+            i += half + 1;
+            n -= half + 1;
+        }
+        else
+            n = half;
+    }
+    return i;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+std::size_t BTree<K,V,F,NodeBytes>::child_position(const Inner* inner, const K& key) const
+{
+    // the first separator greater than the key
+    return std::size_t(std::upper_bound(inner->keys, inner->keys + inner->count, key,
+        [this](const K& k, const key_type& separator) {return cmp(k, separator);}) - inner->keys);
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+typename BTree<K,V,F,NodeBytes>::Leaf* BTree<K,V,F,NodeBytes>::find_leaf(const K& key) const
+{
+    void* node = root;
+    for(std::size_t level = 0; level + 1 < levels; ++level)
+    {
+        Inner* inner = static_cast<Inner*>(node);
+        node = inner->children[child_position(inner, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+typename BTree<K,V,F,NodeBytes>::Leaf* BTree<K,V,F,NodeBytes>::first_leaf() const noexcept
+{
+    void* node = root;
+    for(std::size_t level = 0; level + 1 < levels; ++level)
+        node = static_cast<Inner*>(node)->children[0];
+    return static_cast<Leaf*>(node);
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+typename BTree<K,V,F,NodeBytes>::Iterator BTree<K,V,F,NodeBytes>::find(const K& key)
+{
+    Leaf* leaf = find_leaf(key);
+    if(leaf == nullptr) return end();
+    std::size_t i = leaf_position(leaf, key);
+    if(i < leaf->count && !cmp(key, leaf->entry(i).first))
+        return Iterator{leaf, i};
+    return end();
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+typename BTree<K,V,F,NodeBytes>::ConstIterator BTree<K,V,F,NodeBytes>::find(const K& key) const
+{
+    Leaf* leaf = find_leaf(key);
+    if(leaf == nullptr) return end();
+    std::size_t i = leaf_position(leaf, key);
+    if(i < leaf->count && !cmp(key, leaf->entry(i).first))
+        return ConstIterator{leaf, i};
+    return end();
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::insert_entry(Leaf* leaf, std::size_t i, entry_type&& entry) noexcept
+{
+    // move the following entries one step to the right, starting from the last one
+    for(std::size_t j = leaf->count; j > i; --j)
+    {
+        new (leaf->slot(j)) entry_type(std::move(leaf->entry(j - 1)));
+        leaf->entry(j - 1).~entry_type();
+    }
+    new (leaf->slot(i)) entry_type(std::move(entry));
+    ++leaf->count;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::copy_entries(const Leaf* leaf, std::size_t i, const entry_type& entry, std::size_t from, std::size_t to, Leaf* target)
+{
+    // the count of the target follows the copies, so a throw leaves only built entries to destroy
+    try
+    {
+        for(std::size_t j = from; j < to; ++j)
+        {
+            const entry_type& source = j < i ? leaf->entry(j) : j == i ? entry : leaf->entry(j - 1);
+            new (target->slot(j - from)) entry_type(source);
+            ++target->count;
+        }
+    }
+    catch(...)
+    {
+        while(target->count > 0)
+            target->entry(--target->count).~entry_type();
+        throw;
+    }
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::replace_leaf(Leaf* old, Leaf* fresh, Inner* const* path, const std::size_t* positions) noexcept
+{
+    if(levels == 1)
+        root = fresh;
+    else
+        path[levels - 2]->children[positions[levels - 2]] = fresh;
+    // the leaf on the left is the last one of the subtree before the lowest ancestor not entered from its first child
+    for(std::size_t level = levels - 1; level-- > 0;)
+        if(positions[level] > 0)
+        {
+            void* node = path[level]->children[positions[level] - 1];
+            for(std::size_t below = level + 1; below + 1 < levels; ++below)
+                node = static_cast<Inner*>(node)->children[static_cast<Inner*>(node)->count];
+            static_cast<Leaf*>(node)->next = fresh;
+            break;
+        }
+    destroy(old, levels - 1);
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::insert_child(Inner* inner, std::size_t i, key_type&& key, void* child) noexcept
+{
+    for(std::size_t j = inner->count; j > i; --j)
+    {
+        inner->keys[j] = std::move(inner->keys[j - 1]);
+        inner->children[j + 1] = inner->children[j];
+    }
+    inner->keys[i] = std::move(key);
+    inner->children[i + 1] = child;
+    ++inner->count;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+std::pair<typename BTree<K,V,F,NodeBytes>::Iterator,bool> BTree<K,V,F,NodeBytes>::insert(const K& key, const V& value)
+{
+    if(root == nullptr)
+    {
+        std::unique_ptr<Leaf> first{new Leaf};
+        new (first->slot(0)) entry_type(key, value);
+        Leaf* leaf = first.release();
+        leaf->count = 1;
+        root = leaf;
+        levels = 1;
+        tree_size = 1;
+        return std::pair<Iterator,bool>{Iterator{leaf, 0}, true};
+    }
+    // go down remembering the inner nodes and the child taken in each of them
+    Inner* path[max_levels];
+    std::size_t positions[max_levels];
+    void* node = root;
+    for(std::size_t level = 0; level + 1 < levels; ++level)
+    {
+        Inner* inner = static_cast<Inner*>(node);
+        path[level] = inner;
+        positions[level] = child_position(inner, key);
+        node = inner->children[positions[level]];
+    }
+    Leaf* leaf = static_cast<Leaf*>(node);
+    std::size_t i = leaf_position(leaf, key);
+    // Look if the key is already present
+    if(i < leaf->count && !cmp(key, leaf->entry(i).first))
+        return std::pair<Iterator,bool>{Iterator{leaf, i}, false};
+
+    // the new entry is built before moving anything, in case its construction throws
+    entry_type entry{key, value};
+    if(leaf->count < leaf_capacity)
+    {
+        if constexpr(nothrow_entries)
+            insert_entry(leaf, i, std::move(entry));
+        else
+        {
+            // moving an entry copies its key, which can throw: the leaf is copied with the new entry in a new one,
+            // that takes its place only when all the copies are done
+            std::unique_ptr<Leaf> fresh{new Leaf};
+            copy_entries(leaf, i, entry, 0, leaf->count + 1, fresh.get());
+            fresh->next = leaf->next;
+            replace_leaf(leaf, fresh.get(), path, positions);
+            leaf = fresh.release();
+        }
+        ++tree_size;
+        return std::pair<Iterator,bool>{Iterator{leaf, i}, true};
+    }
+
+    // the nodes needed by the splits are allocated before the tree is touched, so a bad_alloc leaves it as it was:
+    // the full inner nodes above the leaf split, and the root too if they are all full
+    std::size_t splits = 0;
+    while(splits + 1 < levels && path[levels - 2 - splits]->count == inner_capacity)
+        ++splits;
+    std::unique_ptr<Leaf> new_leaf{new Leaf};
+    std::unique_ptr<Leaf> fresh{nothrow_entries ? nullptr : new Leaf};
+    std::unique_ptr<Inner> siblings[max_levels];
+    for(std::size_t j = 0; j < splits; ++j)
+        siblings[j].reset(new Inner);
+    std::unique_ptr<Inner> new_root{splits + 1 == levels ? new Inner : nullptr};
+
+    // the leaf is full: its upper half goes in a new leaf on the right, whose first key goes up in the father
+    const std::size_t half = (leaf_capacity + 1)/2;
+    key_type separator = leaf->entry(half).first;
+    Leaf* right = nullptr;
+    Iterator result{nullptr};
+    if constexpr(nothrow_entries)
+    {
+        right = new_leaf.release();
+        for(std::size_t j = half; j < leaf->count; ++j)
+        {
+            new (right->slot(j - half)) entry_type(std::move(leaf->entry(j)));
+            leaf->entry(j).~entry_type();
+        }
+        right->count = leaf->count - half;
+        leaf->count = half;
+        right->next = leaf->next;
+        leaf->next = right;
+        if(i <= half)
+        {
+            insert_entry(leaf, i, std::move(entry));
+            result = Iterator{leaf, i};
+        }
+        else
+        {
+            insert_entry(right, i - half, std::move(entry));
+            result = Iterator{right, i - half};
+        }
+    }
+    else
+    {
+        // both halves are copied in new leaves, the old one is replaced only when all the copies are done
+        const std::size_t left_count = i <= half ? half + 1 : half;
+        copy_entries(leaf, i, entry, 0, left_count, fresh.get());
+        try
+        {
+            copy_entries(leaf, i, entry, left_count, leaf->count + 1, new_leaf.get());
+        }
+        catch(...)
+        {
+            destroy(fresh.release(), levels - 1);
+            throw;
+        }
+        right = new_leaf.release();
+        right->next = leaf->next;
+        fresh->next = right;
+        replace_leaf(leaf, fresh.get(), path, positions);
+        leaf = fresh.release();
+        result = i < left_count ? Iterator{leaf, i} : Iterator{right, i - left_count};
+    }
+
+    // the separator goes up in the father, splitting it if full, and so on
+    void* child = right;
+    for(std::size_t level = levels - 1; level-- > 0;)
+    {
+        Inner* inner = path[level];
+        if(inner->count < inner_capacity)
+        {
+            insert_child(inner, positions[level], std::move(separator), child);
+            ++tree_size;
+            return std::pair<Iterator,bool>{result, true};
+        }
+        // gather all the keys and children, the middle key goes up
+        key_type keys[inner_capacity + 1];
+        void* children[inner_capacity + 2];
+        std::move(inner->keys, inner->keys + inner->count, keys);
+        std::copy(inner->children, inner->children + inner->count + 1, children);
+        const std::size_t pos = positions[level];
+        std::move_backward(keys + pos, keys + inner_capacity, keys + inner_capacity + 1);
+        std::copy_backward(children + pos + 1, children + inner_capacity + 1, children + inner_capacity + 2);
+        keys[pos] = std::move(separator);
+        children[pos + 1] = child;
+
+        const std::size_t middle = (inner_capacity + 1)/2;
+        Inner* sibling = siblings[levels - 2 - level].release();
+        inner->count = middle;
+        std::move(keys, keys + middle, inner->keys);
+        std::copy(children, children + middle + 1, inner->children);
+        sibling->count = inner_capacity - middle;
+        std::move(keys + middle + 1, keys + inner_capacity + 1, sibling->keys);
+        std::copy(children + middle + 1, children + inner_capacity + 2, sibling->children);
+        separator = std::move(keys[middle]);
+        child = sibling;
+    }
+
+    // the root has been split: the tree grows by one level
+    Inner* top = new_root.release();
+    top->count = 1;
+    top->keys[0] = std::move(separator);
+    top->children[0] = root;
+    top->children[1] = child;
+    root = top;
+    ++levels;
+    ++tree_size;
+    return std::pair<Iterator,bool>{result, true};
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+V& BTree<K,V,F,NodeBytes>::operator[](const K& key)
+{
+    Iterator s_res = find(key);
+    if(s_res != end()) return (*s_res).second;
+    return (*insert(key, V{}).first).second;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+const V& BTree<K,V,F,NodeBytes>::operator[](const K& key) const
+{
+    ConstIterator s_res = find(key);
+    if(s_res != end()) return (*s_res).second;
+    //is a constant method, if it does not find the key it throws an exception
+    throw std::runtime_error("You are trying to acces a non existing key");
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::destroy(void* node, std::size_t level) const noexcept
+{
+    if(level + 1 == levels)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        for(std::size_t i = 0; i < leaf->count; ++i)
+            leaf->entry(i).~entry_type();
+        delete leaf;
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for(std::size_t i = 0; i <= inner->count; ++i)
+        destroy(inner->children[i], level + 1);
+    delete inner;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void BTree<K,V,F,NodeBytes>::clear() noexcept
+{
+    if(root != nullptr) destroy(root, 0);
+    root = nullptr;
+    levels = 0;
+    tree_size = 0;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+void* BTree<K,V,F,NodeBytes>::copy_util(const void* node, std::size_t level, Leaf*& last) const
+{
+    if(level + 1 == levels)
+    {
+        const Leaf* old = static_cast<const Leaf*>(node);
+        Leaf* leaf = new Leaf;
+        try
+        {
+            for(; leaf->count < old->count; ++leaf->count)
+                new (leaf->slot(leaf->count)) entry_type(old->entry(leaf->count));
+        }
+        catch(...)
+        {
+            // the entries copied so far are destroyed with the leaf
+            for(std::size_t i = 0; i < leaf->count; ++i)
+                leaf->entry(i).~entry_type();
+            delete leaf;
+            throw;
+        }
+        if(last != nullptr) last->next = leaf;
+        last = leaf;
+        return leaf;
+    }
+    const Inner* old = static_cast<const Inner*>(node);
+    std::unique_ptr<Inner> inner{new Inner};
+    inner->count = old->count;
+    std::copy(old->keys, old->keys + old->count, inner->keys);
+    std::size_t copied = 0;
+    try
+    {
+        for(; copied <= old->count; ++copied)
+            inner->children[copied] = copy_util(old->children[copied], level + 1, last);
+    }
+    catch(...)
+    {
+        // the children copied so far are freed, the node by its owner
+        for(std::size_t i = 0; i < copied; ++i)
+            destroy(inner->children[i], level + 1);
+        throw;
+    }
+    return inner.release();
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+BTree<K,V,F,NodeBytes>& BTree<K,V,F,NodeBytes>::operator=(const BTree& bt)
+{
+    // copy and swap: a self-assignment or a copy that throws leave the tree as it was
+    BTree tmp{bt};
+    (*this) = std::move(tmp);
+    return *this;
+}
+
+template <class K, class V, class F, std::size_t NodeBytes>
+BTree<K,V,F,NodeBytes>& BTree<K,V,F,NodeBytes>::operator=(BTree&& bt) noexcept
+{
+    if(this == &bt) return *this;
+    clear();
+    std::swap(root, bt.root);
+    std::swap(levels, bt.levels);
+    std::swap(tree_size, bt.tree_size);
+    cmp = std::move(bt.cmp);
+    return *this;
+}
+
+template <class k, class v, class f, std::size_t n>
+std::ostream& operator<<(std::ostream& os, const BTree<k,v,f,n>& bt)
+{
+    for(const auto& vals : bt)
+        os << "(" << vals.first << ":" << vals.second << ") ";
+    os << std::endl;
+    return os;
+}
+
+#endif
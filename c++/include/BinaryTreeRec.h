@@ -9,55 +9,930 @@
  * 
  */
 
+#ifndef __BINARYTREEREC__
+#define __BINARYTREEREC__
+
 #include <iostream>
 #include <memory>
 #include <algorithm>
 #include <utility>
 #include <string>
 #include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <stdexcept>
+#include <iterator>
+#include <cassert>
+#include <chrono>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
 
-namespace {
+/**
+ * @brief The helpers of the comparing functions, in a named namespace so that they have external linkage:
+ * default_less is the default comparing function of the trees, and a type in an unnamed namespace would make
+ * BinaryTree<K,V> a different type in every translation unit
+ */
+namespace bt_detail
+{
 template <class K>
 bool default_comparator(const K& k1, const K& k2) {return k1 < k2;}
+
+/**
+ * @brief True if a key of type T has a compare(u) member, for a key u of type U, returning an int
+ */
+template <class T, class U, class = void>
+struct has_member_compare : std::false_type {};
+template <class T, class U>
+struct has_member_compare<T, U, std::void_t<decltype(int(std::declval<const T&>().compare(std::declval<const U&>())))>>
+    : std::true_type {};
+
+/**
+ * @brief The three-way comparison of two keys, through the compare() of one of them if there is one (e.g. std::string),
+ * otherwise through two < operators without branches
+ */
+template <class K1, class K2>
+int three_way(const K1& k1, const K2& k2)
+{
+    if constexpr (has_member_compare<K1, K2>::value)
+        return k1.compare(k2);
+    else if constexpr (has_member_compare<K2, K1>::value)
+    {
+        // the sign is flipped without negating, that overflows for INT_MIN
+        const int reversed = k2.compare(k1);
+        return int(reversed < 0) - int(reversed > 0);
+    }
+    else
+        return int(k2 < k1) - int(k1 < k2);
+}
+
+/**
+ * @brief The default comparing function of the trees: the < operator of the keys, in a function object
+ * 
+ * Unlike a pointer to default_comparator, it can be inlined. It also offers a three-way compare(), that tells in
+ * a single call if a key is less, equal or greater than another one: it uses the compare() of the key when there
+ * is one (e.g. std::string), otherwise two < operators without branches.
+ */
+template <class K = void>
+struct default_less
+{
+    bool operator()(const K& k1, const K& k2) const {return k1 < k2;}
+    int compare(const K& k1, const K& k2) const {return three_way(k1, k2);}
+};
+
+/**
+ * @brief The transparent version of default_less, that compares keys of any types having a < operator between them
+ * 
+ * Like std::less<>, it defines is_transparent: find(), count(), contains() and lower_bound() of a tree ordered by
+ * default_less<> take any type comparable with the keys, e.g. a std::string_view or a const char* for std::string keys,
+ * without building a key for every lookup.
+ */
+template <>
+struct default_less<void>
+{
+    using is_transparent = void;
+    template <class K1, class K2>
+    bool operator()(const K1& k1, const K2& k2) const {return k1 < k2;}
+    template <class K1, class K2>
+    int compare(const K1& k1, const K2& k2) const {return three_way(k1, k2);}
+};
+
+/**
+ * @brief True if a comparing function F offers a three-way compare(q, k), negative, zero or positive if q is
+ * less, equivalent or greater than the key k; q is a key too, or any type a transparent F compares with the keys
+ */
+template <class F, class K, class Q = K, class = void>
+struct has_three_way : std::false_type {};
+template <class F, class K, class Q>
+struct has_three_way<F, K, Q, std::void_t<decltype(int(std::declval<const F&>().compare(std::declval<const Q&>(), std::declval<const K&>())))>>
+    : std::true_type {};
+
+/** the number of lookups that the find_batch() of the trees walk together */
+inline constexpr std::size_t batch_width = 16;
+
+/**
+ * @brief The comparing function used when none is given: default_comparator for the function pointers, else F{}
+ */
+template <class F, class K>
+F make_default_comparator()
+{
+    if constexpr (std::is_convertible<decltype(&default_comparator<K>), F>::value)
+        return &default_comparator<K>;
+    else
+        return F{};
+}
+}
+
+using bt_detail::default_comparator;
+using bt_detail::default_less;
+using bt_detail::has_three_way;
+using bt_detail::batch_width;
+using bt_detail::make_default_comparator;
+
+/**
+ * @brief Balancing policies that can be plugged in a BinaryTree
+ * 
+ * A policy is a class that provides:
+ * - a `node_data` structure, from which every node inherits the fields the policy needs (e.g. the color);
+ * - a `records_path` flag, that tells the tree to keep track of the links followed during an insertion;
+ * - an `inserted(path, length, size)` function, called after the insertion of a new node with the list of
+ *   the links (references to the unique pointers) from the root down to the new node;
+ * - a `records_access` flag, if true also find() records its path and calls `accessed(path, length)`,
+ *   where the last link is the one of the found node or the empty one where the search stopped;
+ * - a `rebuilt(link, height)` function, called after BinaryTree::balance() has relinked the whole tree
+ *   in a complete tree of the given height, to set again the data of the nodes.
+ * 
+ * Since the `_parent` pointer of a node is not its father but its in-order successor between the ancestors,
+ * the policies walk the tree upward through the recorded path instead of following the `_parent` links.
+ */
+namespace balancing
+{
+/**
+ * @brief Left rotation of the subtree owned by a link
+ * 
+ * The right child of the node takes its place. Only the `_parent` pointer of the old root changes,
+ * since it becomes the left child of the new root.
+ * 
+ * @tparam Link the unique pointer type of the nodes
+ * @param link the link that owns the subtree (it must have a right child)
+ */
+template <class Link>
+void rotate_left(Link& link) noexcept
+{
+    Link right = std::move(link->_right);
+    link->_right = std::move(right->_left);
+    right->_left = std::move(link);
+    link = std::move(right);
+    link->_left->_parent = link.get();
+}
+
+/**
+ * @brief Right rotation of the subtree owned by a link
+ * 
+ * The left child of the node takes its place and inherits the `_parent` pointer of the old root.
+ * 
+ * @tparam Link the unique pointer type of the nodes
+ * @param link the link that owns the subtree (it must have a left child)
+ */
+template <class Link>
+void rotate_right(Link& link) noexcept
+{
+    Link left = std::move(link->_left);
+    link->_left = std::move(left->_right);
+    left->_right = std::move(link);
+    link = std::move(left);
+    link->_parent = link->_right->_parent;
+}
+
+/**
+ * @brief The original behaviour: no balancing at all
+ * 
+ * The shape of the tree depends only on the insertion order, an ordered sequence of keys
+ * produces a linked list. Call BinaryTree::balance() to rebuild it.
+ */
+struct none
+{
+    /** no data in the nodes */
+    struct node_data {};
+    /** the insertion path is not needed */
+    static constexpr bool records_path = false;
+    /** the lookups do not change the tree */
+    static constexpr bool records_access = false;
+    /** nothing to do after an insertion */
+    template <class Link>
+    void inserted(Link* const*, std::size_t, std::size_t) noexcept {}
+    /** nor after a rebuild */
+    template <class Link>
+    void rebuilt(Link&, std::size_t) noexcept {}
+};
+
+/**
+ * @brief Red-black tree balancing
+ * 
+ * Every node is red or black, a red node has no red children and all the paths from a node to its
+ * leaves contain the same number of black nodes, so the height is at most 2*log2(n+1).
+ * The invariants are restored after every insertion with at most two rotations.
+ */
+struct red_black
+{
+    /** the color of the node, a new node is red */
+    struct node_data { bool red = true; };
+    /** the fix-up goes from the new node up to the root */
+    static constexpr bool records_path = true;
+    /** the lookups do not change the tree */
+    static constexpr bool records_access = false;
+
+    /**
+     * @brief Restores the red-black invariants after an insertion
+     * 
+     * @param path the links from the root (path[0]) to the new node (path[length-1])
+     * @param length the number of links in the path
+     */
+    template <class Link>
+    void inserted(Link* const* path, std::size_t length, std::size_t) noexcept
+    {
+        std::size_t i = length - 1;
+        // a red node with a red parent: the grandparent exists since the root is black
+        while(i >= 2 && (*path[i-1])->red)
+        {
+            Link& grandparent = *path[i-2];
+            const bool left_side = grandparent->_left.get() == path[i-1]->get();
+            Link& uncle = left_side ? grandparent->_right : grandparent->_left;
+            if(uncle && uncle->red)
+            {
+                // push the red color up and continue from the grandparent
+                uncle->red = false;
+                (*path[i-1])->red = false;
+                grandparent->red = true;
+                i -= 2;
+                continue;
+            }
+            // the new node is an inner grandchild: move it outside
+            const bool inner = left_side ? (*path[i-1])->_right.get() == path[i]->get()
+                                         : (*path[i-1])->_left.get() == path[i]->get();
+            if(inner)
+                left_side ? rotate_left(*path[i-1]) : rotate_right(*path[i-1]);
+            left_side ? rotate_right(grandparent) : rotate_left(grandparent);
+            grandparent->red = false;
+            (left_side ? grandparent->_right : grandparent->_left)->red = true;
+            break;
+        }
+        (*path[0])->red = false;
+    }
+
+    /**
+     * @brief Colors a complete tree: the nodes of the last level are red, all the other ones black
+     * 
+     * Every path from the root to a leaf then meets height-1 black nodes, and a red node is a leaf.
+     * 
+     * @param link the root of the tree
+     * @param height the number of levels
+     */
+    template <class Link>
+    void rebuilt(Link& link, std::size_t height) noexcept {paint(link, height, 1);}
+
+    private:
+    /** colors a subtree whose root is at the given level */
+    template <class Link>
+    static void paint(Link& link, std::size_t height, std::size_t level) noexcept
+    {
+        if(!link) return;
+        link->red = level > 1 && level == height;
+        paint(link->_left, height, level + 1);
+        paint(link->_right, height, level + 1);
+    }
+};
+
+/**
+ * @brief AVL tree balancing
+ * 
+ * The heights of the two subtrees of every node differ at most by one, so the height is at most
+ * about 1.44*log2(n): the tree is shallower than a red-black one, at the cost of some more rotations.
+ */
+struct avl
+{
+    /** the height of the subtree rooted in the node, a new node is a leaf */
+    struct node_data { int height = 1; };
+    /** the heights are updated from the new node up to the root */
+    static constexpr bool records_path = true;
+    /** the lookups do not change the tree */
+    static constexpr bool records_access = false;
+
+    /**
+     * @brief Updates the heights and rotates the first unbalanced ancestor of the new node
+     * 
+     * @param path the links from the root (path[0]) to the new node (path[length-1])
+     * @param length the number of links in the path
+     */
+    template <class Link>
+    void inserted(Link* const* path, std::size_t length, std::size_t) noexcept
+    {
+        for(std::size_t i = length - 1; i-- > 0;)
+        {
+            Link& link = *path[i];
+            const int old_height = link->height;
+            const int balance = height(link->_left) - height(link->_right);
+            if(balance > 1)
+            {
+                // left-right case: the left child leans on the right
+                if(height(link->_left->_left) < height(link->_left->_right))
+                {
+                    rotate_left(link->_left);
+                    update(link->_left->_left);
+                    update(link->_left);
+                }
+                rotate_right(link);
+                update(link->_right);
+            }
+            else if(balance < -1)
+            {
+                // right-left case: the right child leans on the left
+                if(height(link->_right->_right) < height(link->_right->_left))
+                {
+                    rotate_right(link->_right);
+                    update(link->_right->_right);
+                    update(link->_right);
+                }
+                rotate_left(link);
+                update(link->_left);
+            }
+            update(link);
+            // the ancestors are not affected if the height did not change
+            if(link->height == old_height) break;
+        }
+    }
+
+    /**
+     * @brief Recomputes all the heights, a complete tree is always an AVL tree
+     * 
+     * @param link the root of the tree
+     */
+    template <class Link>
+    void rebuilt(Link& link, std::size_t) noexcept
+    {
+        if(!link) return;
+        rebuilt(link->_left, 0);
+        rebuilt(link->_right, 0);
+        update(link);
+    }
+
+    private:
+    /** the height of a subtree, 0 if empty */
+    template <class Link>
+    static int height(const Link& link) noexcept {return link ? link->height : 0;}
+    /** recomputes the height of a node from the ones of its children */
+    template <class Link>
+    static void update(Link& link) noexcept {link->height = 1 + std::max(height(link->_left), height(link->_right));}
+};
+
+/**
+ * @brief Counts the nodes of a subtree
+ * 
+ * @param link the link that owns the subtree
+ * @return std::size_t the number of nodes
+ */
+template <class Link>
+std::size_t subtree_size(const Link& link) noexcept
+{
+    return link ? 1 + subtree_size(link->_left) + subtree_size(link->_right) : 0;
+}
+
+/**
+ * @brief Folds the first nodes of a vine, one every two, with left rotations
+ * 
+ * @param link the link that owns the vine (a list linked through the right children)
+ * @param count the number of rotations
+ */
+template <class Link>
+void compress(Link& link, std::size_t count) noexcept
+{
+    Link* scanner = &link;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        rotate_left(*scanner);
+        scanner = &(*scanner)->_right;
+    }
+}
+
+/**
+ * @brief Rebuilds a subtree perfectly balanced in place (Day-Stout-Warren algorithm)
+ * 
+ * Right rotations first turn the subtree in a vine, sorted along the right children. Then rounds of
+ * left rotations fold the vine in a complete tree: the nodes of an incomplete last level are moved
+ * out first, and every following round halves the length of the vine. The rotations keep the `_parent`
+ * pointers right, so the nodes are only relinked: it takes O(n) time and O(1) memory, without
+ * allocating, moving an entry or comparing a key.
+ * 
+ * @param link the link that owns the subtree
+ * @param size the number of nodes in the subtree
+ * @return std::size_t the height of the new subtree
+ */
+template <class Link>
+std::size_t rebuild(Link& link, std::size_t size) noexcept
+{
+    for(Link* tail = &link; *tail;)
+    {
+        if((*tail)->_left)
+            rotate_right(*tail);
+        else
+            tail = &(*tail)->_right;
+    }
+    // the number of full levels
+    std::size_t height = 0;
+    while((std::size_t(2) << height) - 1 <= size)
+        ++height;
+    std::size_t full = (std::size_t(1) << height) - 1;
+    compress(link, size - full);
+    for(std::size_t length = full; length > 1;)
+    {
+        length /= 2;
+        compress(link, length);
+    }
+    return size > full ? height + 1 : height;
+}
+
+/**
+ * @brief Splay tree balancing
+ * 
+ * Every accessed node (found, inserted or already present) is moved up to the root with a sequence of
+ * zig-zig and zig-zag double rotations. The nodes carry no balancing information and the tree is not
+ * balanced in the usual sense, but the operations cost O(log n) amortized time and the recently
+ * used keys stay close to the root, which pays off when few keys get most of the accesses.
+ */
+struct splay
+{
+    /** no data in the nodes */
+    struct node_data {};
+    /** the new node is moved to the root */
+    static constexpr bool records_path = true;
+    /** and so are the found ones */
+    static constexpr bool records_access = true;
+
+    /**
+     * @brief Moves the new node to the root
+     * 
+     * @param path the links from the root (path[0]) to the new node (path[length-1])
+     * @param length the number of links in the path
+     */
+    template <class Link>
+    void inserted(Link* const* path, std::size_t length, std::size_t) noexcept {splay_up(path, length);}
+    /** nothing to do after a rebuild */
+    template <class Link>
+    void rebuilt(Link&, std::size_t) noexcept {}
+
+    /**
+     * @brief Moves the found node, or the last one visited if the key is missing, to the root
+     * 
+     * @param path the links from the root (path[0]) to the found node (path[length-1])
+     * @param length the number of links in the path
+     */
+    template <class Link>
+    void accessed(Link* const* path, std::size_t length) noexcept
+    {
+        // a failed search ends on an empty link
+        if(length > 1 && *path[length-1] == nullptr) --length;
+        if(length > 0 && *path[length-1] != nullptr) splay_up(path, length);
+    }
+
+    private:
+    /**
+     * @brief The splay operation: brings the last node of the path to the root
+     * 
+     * The rotations happen on the links of the grandparents: after each step the node
+     * takes the link of its old grandparent, so the links above it in the path stay valid.
+     */
+    template <class Link>
+    static void splay_up(Link* const* path, std::size_t length) noexcept
+    {
+        std::size_t i = length - 1;
+        while(i >= 2)
+        {
+            Link& grandparent = *path[i-2];
+            Link& parent = *path[i-1];
+            const bool parent_left = grandparent->_left.get() == parent.get();
+            const bool node_left = parent->_left.get() == path[i]->get();
+            // zig-zig: the grandparent is rotated first, zig-zag: the parent is rotated first
+            if(parent_left == node_left)
+                parent_left ? rotate_right(grandparent) : rotate_left(grandparent);
+            else
+                node_left ? rotate_right(parent) : rotate_left(parent);
+            parent_left ? rotate_right(grandparent) : rotate_left(grandparent);
+            i -= 2;
+        }
+        // zig: the node is a child of the root
+        if(i == 1)
+            (*path[0])->_left.get() == path[1]->get() ? rotate_right(*path[0]) : rotate_left(*path[0]);
+    }
+};
+
+/**
+ * @brief Scapegoat tree balancing
+ * 
+ * The nodes carry no balancing information. When an insertion goes deeper than log(n)/log(1/alpha),
+ * the subtree sizes are computed going up from the new node until the first ancestor (the scapegoat)
+ * whose child is heavier than alpha times its own size: only the subtree of the scapegoat is rebuilt.
+ * The insertions cost O(log n) amortized time.
+ */
+struct scapegoat
+{
+    /** no data in the nodes */
+    struct node_data {};
+    /** the scapegoat is searched going up from the new node */
+    static constexpr bool records_path = true;
+    /** the lookups do not change the tree */
+    static constexpr bool records_access = false;
+    /** the weight balance factor, between 0.5 (rigid) and 1 (loose) */
+    double alpha;
+
+    /**
+     * @brief Construct a new scapegoat policy
+     * 
+     * @param a the weight balance factor alpha
+     */
+    scapegoat(double a = 0.7) : alpha{a} {}
+
+    /**
+     * @brief Rebuilds the subtree of the scapegoat if the new node is too deep
+     * 
+     * @param path the links from the root (path[0]) to the new node (path[length-1])
+     * @param length the number of links in the path
+     * @param size the number of nodes in the tree
+     */
+    template <class Link>
+    void inserted(Link* const* path, std::size_t length, std::size_t size)
+    {
+        const double max_depth = std::log(double(size))/std::log(1/alpha);
+        if(double(length - 1) <= max_depth) return;
+        std::size_t child_size = 1;
+        for(std::size_t i = length - 1; i-- > 0;)
+        {
+            Link& link = *path[i];
+            const Link& sibling = link->_left.get() == path[i+1]->get() ? link->_right : link->_left;
+            const std::size_t node_size = child_size + 1 + subtree_size(sibling);
+            if(double(child_size) > alpha*double(node_size))
+            {
+                rebuild(link, node_size);
+                return;
+            }
+            child_size = node_size;
+        }
+    }
+    /** nothing to do after a rebuild */
+    template <class Link>
+    void rebuilt(Link&, std::size_t) noexcept {}
+};
+
+/**
+ * @brief Treap balancing
+ * 
+ * Every node gets a random priority and the tree is kept in heap order by priority, so its shape is the
+ * one of a tree built inserting the keys in random order: the expected height is O(log n) whatever
+ * the real insertion order is. The nodes also store the size of their subtree, this allows to split
+ * a tree by key and to join two trees in O(log n) expected time (see BinaryTree::split() and BinaryTree::join()).
+ */
+struct treap
+{
+    /** the random priority and the size of the subtree rooted in the node */
+    struct node_data { unsigned priority = 0; std::size_t size = 1; };
+    /** the new node goes up while its priority is higher than the one of its father */
+    static constexpr bool records_path = true;
+    /** the lookups do not change the tree */
+    static constexpr bool records_access = false;
+    /** the source of the priorities, a seed can be drawn from it also when the tree is const (e.g. to copy it) */
+    mutable std::minstd_rand generator;
+
+    /**
+     * @brief Construct a new treap policy
+     * 
+     * @param seed the seed of the random priorities
+     */
+    treap(unsigned seed = std::minstd_rand::default_seed) : generator{seed} {}
+    /**
+     * @brief Restarts the priorities from a new seed
+     * @param seed the seed of the random priorities
+     */
+    void reseed(unsigned seed) {generator.seed(seed);}
+    /**
+     * @brief Draws a seed for another treap, e.g. the part split from this one or a copy
+     * 
+     * The next random number is scrambled first: a minstd_rand seeded with its own output would just go on
+     * with the same sequence as this one.
+     * @return unsigned the seed
+     */
+    unsigned fork_seed() const
+    {
+        std::uint32_t x = std::uint32_t(generator());
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return unsigned(x);
+    }
+
+    /**
+     * @brief Gives a priority to the new node and rotates it up to restore the heap order
+     * 
+     * @param path the links from the root (path[0]) to the new node (path[length-1])
+     * @param length the number of links in the path
+     */
+    template <class Link>
+    void inserted(Link* const* path, std::size_t length, std::size_t)
+    {
+        (*path[length-1])->priority = unsigned(generator());
+        for(std::size_t i = 0; i + 1 < length; ++i)
+            ++(*path[i])->size;
+        for(std::size_t i = length - 1; i > 0 && (*path[i])->priority > (*path[i-1])->priority; --i)
+        {
+            Link& parent = *path[i-1];
+            const bool left = parent->_left.get() == path[i]->get();
+            left ? rotate_right(parent) : rotate_left(parent);
+            // the old father is now a child of the new node
+            update(left ? parent->_right : parent->_left);
+            update(parent);
+        }
+    }
+
+    /**
+     * @brief Gives new priorities to a complete tree, decreasing with the depth, and recomputes the sizes
+     * 
+     * The priorities of every level are drawn at random in their own band, below the band of the level
+     * above, so the heap order holds and the next insertions still find random priorities.
+     * 
+     * @param link the root of the tree
+     * @param height the number of levels
+     */
+    template <class Link>
+    void rebuilt(Link& link, std::size_t height)
+    {
+        if(height > 0) prioritize(link, std::numeric_limits<unsigned>::max()/unsigned(height), height - 1);
+    }
+
+    /**
+     * @brief Splits a treap by key
+     * 
+     * @param link the treap, after the call it contains only the keys less than the given one
+     * @param key the key where to split
+     * @param cmp the comparison function of the tree
+     * @param right where to put the keys not less than the given one
+     */
+    template <class Link, class Key, class Cmp>
+    static void split(Link& link, const Key& key, const Cmp& cmp, Link& right)
+    {
+        Link left;
+        split(std::move(link), key, cmp, nullptr, left, right);
+        link = std::move(left);
+    }
+
+    /**
+     * @brief Joins two treaps
+     * 
+     * @param link the first treap, after the call it contains both
+     * @param right the second treap, all its keys must be greater than the ones of the first
+     */
+    template <class Link>
+    static void join(Link& link, Link&& right)
+    {
+        link = merge(std::move(link), std::move(right), nullptr);
+    }
+
+    private:
+    /** the size of a subtree, 0 if empty */
+    template <class Link>
+    static std::size_t size(const Link& link) noexcept {return link ? link->size : 0;}
+    /** recomputes the size of a node from the ones of its children */
+    template <class Link>
+    static void update(Link& link) noexcept {if(link) link->size = 1 + size(link->_left) + size(link->_right);}
+
+    /** draws the priorities of a subtree whose root is in the given band, from the bottom one (0) */
+    template <class Link>
+    void prioritize(Link& link, unsigned band, std::size_t level)
+    {
+        if(!link) return;
+        link->priority = band*unsigned(level) + unsigned(generator() % band);
+        prioritize(link->_left, band, level - 1);
+        prioritize(link->_right, band, level - 1);
+        update(link);
+    }
+
+    /**
+     * @brief Recursive split
+     * 
+     * The nodes with a key less than the given one always end on the right spine of the left tree,
+     * so their successor is null. The other ones are attached as left children, and their successor
+     * does not change: it is the last node where the split went left.
+     */
+    template <class Link, class Key, class Cmp>
+    static void split(Link node, const Key& key, const Cmp& cmp, typename Link::pointer successor, Link& left, Link& right)
+    {
+        if(!node) return;
+        if(cmp(node->entry.first, key))
+        {
+            node->_parent = nullptr;
+            split(std::move(node->_right), key, cmp, successor, node->_right, right);
+            update(node);
+            left = std::move(node);
+        }
+        else
+        {
+            node->_parent = successor;
+            split(std::move(node->_left), key, cmp, node.get(), left, node->_left);
+            update(node);
+            right = std::move(node);
+        }
+    }
+
+    /**
+     * @brief Recursive join, the root with the higher priority stays on top
+     * 
+     * @param successor the `_parent` of the root of the result
+     */
+    template <class Link>
+    static Link merge(Link left, Link right, typename Link::pointer successor)
+    {
+        if(!left) return right;
+        if(!right)
+        {
+            // the right spine of the left tree had no successor
+            for(auto node = left.get(); node != nullptr; node = node->_right.get())
+                node->_parent = successor;
+            return left;
+        }
+        if(left->priority > right->priority)
+        {
+            left->_parent = successor;
+            left->_right = merge(std::move(left->_right), std::move(right), successor);
+            update(left);
+            return left;
+        }
+        right->_parent = successor;
+        right->_left = merge(std::move(left), std::move(right->_left), right.get());
+        update(right);
+        return right;
+    }
+};
+}
+
+template <class K, class V, class F>
+class FrozenTree;
+
+namespace interleave
+{
+class task;
+}
+
+/**
+ * @brief Tells if an allocator gives its memory back all at once, so that freeing a single node does nothing
+ * 
+ * When it is true and the entries are trivially destructible, a BinaryTree is cleared or destroyed without
+ * visiting its nodes. It is true for the polymorphic allocators on a std::pmr::monotonic_buffer_resource,
+ * an overload can be added for other arena allocators. It is false for a node_pool: a freed node goes back
+ * in its free list and is reused by the next allocation, while skipping it would make the pool grow until release().
+ */
+template <class A>
+bool releases_in_bulk(const A&) noexcept {return false;}
+template <class T>
+bool releases_in_bulk(const std::pmr::polymorphic_allocator<T>& alloc) noexcept
+{
+    return dynamic_cast<std::pmr::monotonic_buffer_resource*>(alloc.resource()) != nullptr;
+}
+
+/**
+ * @brief Estimates the bytes that an allocator spends beyond a request of the given size
+ * 
+ * The default is the estimate for malloc, behind std::allocator and the new_delete_resource: a header of
+ * one word and a rounding to 16 bytes, with chunks of at least 32 bytes. The resources that carve the
+ * nodes from large blocks (e.g. node_pool) are taken as exact; an overload can be added for other allocators.
+ */
+template <class A>
+std::size_t allocation_overhead(const A&, std::size_t bytes) noexcept
+{
+    const std::size_t chunk = std::max<std::size_t>(32, (bytes + sizeof(void*) + 15) & ~std::size_t(15));
+    return chunk - bytes;
+}
+template <class T>
+std::size_t allocation_overhead(const std::pmr::polymorphic_allocator<T>& alloc, std::size_t bytes) noexcept
+{
+    if(alloc.resource() == std::pmr::new_delete_resource())
+        return allocation_overhead(std::allocator<T>{}, bytes);
+    return 0;
 }
 
 /**
  * @brief Class that implements a binary tree 
  * 
- * The implementation is a simple not autobalancing Binary tree, it is constructed with
+ * By default the implementation is a simple not autobalancing Binary tree, it is constructed with
  * a constant templated key, a templated value and a templated comparing default_comparatorion (the default
  *  is the < operator of the key type). It has a unique pointer to the root node.
+ * A balancing policy (see the balancing namespace) can be given to keep the tree balanced at every insertion.
+ * The nodes are allocated with an allocator, through std::allocator_traits: the tree keeps it once and frees
+ * every node itself, so a node has the same size with any allocator. See also pmr::BinaryTree and node_pool.
  * 
  * @tparam K the key type
  * @tparam V the value stored in the node
  * @tparam std::less<K> the comparing function(defaul <)
+ * @tparam B the balancing policy (default balancing::none)
+ * @tparam A the allocator, rebound to the nodes (default std::allocator)
  */
-template <class K, class V, class F = decltype(&::default_comparator<K>)>
+template <class K, class V, class F = ::default_less<K>, class B = balancing::none,
+          class A = std::allocator<std::pair<const K, V>>>
 class BinaryTree
 {
+    public:
+    /**
+     * @brief Counters of the automatic rebalancing (see auto_balance())
+     */
+    struct balance_counters
+    {
+        /** the deepest level reached by a search since the last rebuild (the root is at level 1) */
+        std::size_t max_depth = 0;
+        /** the number of automatic rebuilds */
+        std::size_t rebuilds = 0;
+        /** the number of nodes relinked by them */
+        std::size_t relinked_nodes = 0;
+        /** the time spent in them */
+        std::chrono::nanoseconds time{0};
+    };
+
+    /**
+     * @brief Counters of the recycling of the nodes (see reserve())
+     */
+    struct recycle_counters
+    {
+        /** the nodes taken from the free list */
+        std::size_t reused = 0;
+        /** the nodes taken from the allocator */
+        std::size_t allocated = 0;
+        /** the fraction of the new nodes that were recycled */
+        double hit_rate() const noexcept {return reused + allocated == 0 ? 0 : double(reused)/double(reused + allocated);}
+    };
+
+    /**
+     * @brief The memory used by a tree (see memory_usage())
+     */
+    struct memory_footprint
+    {
+        /** the number of nodes, one for each entry */
+        std::size_t nodes = 0;
+        /** the bytes of the nodes */
+        std::size_t node_bytes = 0;
+        /** the bytes spent beyond them: the estimated overhead of the allocator, the spare nodes and the buffers */
+        std::size_t slack = 0;
+        /** the bytes used for every entry, slack included */
+        double bytes_per_entry() const noexcept {return nodes == 0 ? 0 : double(node_bytes + slack)/double(nodes);}
+    };
+
+    /** the allocator given to the constructor */
+    using allocator_type = A;
+
+    /**
+     * @brief The orders in which compact() lays out the nodes
+     */
+    enum class order
+    {
+        /** every node is followed by its left subtree, then by its right one: a lookup goes forward in memory */
+        pre_order,
+        /** level by level: the top levels, visited by every lookup, share few cache lines and pages */
+        breadth_first
+    };
+
+    private:
+    struct Node;
+    /** the allocator of the nodes */
+    using node_allocator = typename std::allocator_traits<A>::template rebind_alloc<Node>;
+    /** the allocator traits of the nodes */
+    using node_traits = std::allocator_traits<node_allocator>;
+
+    /**
+     * @brief Deleter of the links: it is empty, so a link is just a pointer whatever the allocator
+     * 
+     * Only the tree has the allocator, and it frees the nodes itself (see destroy()): a link must be
+     * released before it goes away with a node, the assertion catches the ones that would leak it.
+     */
+    struct node_deleter
+    {
+        void operator()(Node*) const noexcept {assert(false && "a node is freed only by its tree");}
+    };
+    /** the owning link to a node */
+    using Link = std::unique_ptr<Node, node_deleter>;
+
     /**
      * @brief A structure that represent the node of the tree
      * A private container that takes the unique pointers to the left and right child, a pointer
-     * to the parent and the entry, a pair with key and value.
+     * to the parent and the entry, a pair with key and value. The fields needed by the balancing
+     * policy are inherited from its node_data.
      */
-    struct Node
+    struct Node : B::node_data
     {   
         /** left child */
-        std::unique_ptr<Node> _left;
+        Link _left;
         /** right child */
-        std::unique_ptr<Node> _right;
+        Link _right;
         /** parent node */
         Node* _parent;
         /** pair with key and value */
         std::pair<const K, V> entry; 
         /** construct a new Node object */
-        Node(const K& key, const V& value, Node* parent,Node* left = nullptr, Node* right = nullptr): 
-        _left{left}, _right{right}, _parent{parent},entry{std::pair<K,V>(key,value)} {}
+        Node(const K& key, const V& value, Node* parent): 
+        _left{}, _right{}, _parent{parent},entry{std::pair<K,V>(key,value)} {}
         /** default destructor */
         ~Node() noexcept = default;
     };
+    /** the allocator of the nodes */
+    node_allocator alloc;
     /** Unique pointer to the root */
-    std::unique_ptr<Node> root = nullptr;
+    Link root;
+    /** number of nodes in the tree */
+    std::size_t tree_size = 0;
+    /** the balancing policy */
+    B balancer;
+    /** list of references to the links followed by a search, from the root downward */
+    using link_path = std::vector<Link*>;
+    /** buffer for the insertion path, reused by every insert() if the policy records it */
+    link_path path;
     /**
      * @brief A function to calculate the first node (following the key order)
      * @return Node* a pointer to the first node
@@ -65,62 +940,226 @@ class BinaryTree
     Node* first_node() const noexcept;
     /** The comparison operator, a functional object that returns a boolean */
     F cmp;
+    /** the allowed depth in units of log2(size), 0 if the automatic rebalancing is disabled */
+    double depth_factor = 0;
+    /** if true the automatic rebuilds wait for idle() */
+    bool deferred_balance = false;
+    /** a deferred rebuild is waiting */
+    bool balance_pending = false;
+    /** the levels visited beyond the allowed depth since the last rebuild */
+    std::size_t depth_debt = 0;
+    /** the counters of the automatic rebalancing */
+    balance_counters stats;
+    /** the freed nodes kept for the next insertions, already destroyed but not deallocated */
+    std::vector<Node*> spare;
+    /** the maximum number of spare nodes, 0 if the recycling is disabled */
+    std::size_t spare_limit = 0;
+    /** the counters of the recycling */
+    recycle_counters recycle_stats;
 
     /**
-    * @brief auxiliary recursive function that implements the search algorithm used in insert and find functions
+     * @brief Records the depth reached by a search and rebalances the tree if it has been too deep for too long
+     * @param depth the number of nodes visited by the search
+     */
+    void observe(std::size_t depth);
+    /** balances the tree and updates the counters of the automatic rebalancing */
+    void auto_rebuild();
+    /**
+     * @brief Gives the policy of a copy its own random numbers, if it draws any (e.g. the priorities of a treap)
+     * 
+     * With a copy of the generator the next insertions would get the same priorities in the copy and in the source.
+     * @param source the copied tree
+     */
+    void fork_balancer(const BinaryTree& source)
+    {
+        if constexpr (requires {balancer.reseed(source.balancer.fork_seed());})
+            balancer.reseed(source.balancer.fork_seed());
+    }
+
+    /**
+    * @brief the search algorithm used by insert, find and operator[]
     * 
     * 
-    * Given a pointer to a node, a key, and a pointer to a parent, this function look for the 
-    * correct place where to find (or to put) an element with this key in the subtree determined by the given node.
+    * Given a link, a key, and a pointer to a parent, this function look for the 
+    * correct place where to find (or to put) an element with this key in the subtree determined by the given link.
     * This function will return also the correct parent to assign to the node in the case of insertion.
     * The correct parent is the first ancestor which key is greater than the actual node's key.
+    * It is a loop: at every node both children are prefetched before the keys are compared, so the next node
+    * is already on its way from memory whichever side the search takes.
+    *
+    * When the key is not found the parent is also the lower bound of the key, the first node with a greater key.
+    * The key can be of any type Q the comparing function compares with the keys: a K, or with a transparent
+    * comparing function whatever it accepts (e.g. a std::string_view for std::string keys).
     *
-    * @tparam std::unique_ptr<Node>& reference to a unique pointer to a node
-    * @tparam const K& reference to the key
+    * @tparam Link& reference to a unique pointer to a node
+    * @tparam const Q& reference to the key
     * @tparam Node* pointer to the right parent for the insertion
-    * @return std::pair< std::unique_ptr<Node>&, Node* > pair with the reference to the target branch and the pointer to the correct parent
+    * @tparam link_path* if not null, the links followed by the search are appended to it
+    * @tparam std::size_t* if not null, it is incremented for every visited node
+    * @return std::pair< Link&, Node* > pair with the reference to the target branch and the pointer to the correct parent
     */
-    std::pair< std::unique_ptr<Node>&, Node* > search(std::unique_ptr<Node>& node,const K& key, Node* old ) const;
-
+    template <class Q>
+    std::pair< Link&, Node* > search(Link& node,const Q& key, Node* old, link_path* trace = nullptr, std::size_t* depth = nullptr) const;
     /**
-    * @brief auxiliary recursive function that implements the balancing algorithm used in the balance() function
-    * 
-    * 
-    * Given a list of pair (key,value), this function insert in the tree the elements of the list from a given begin index to 
-    * a given end index, in an order such that the tree will be perfectly balanced. 
-    *
-    * @tparam std::vector<std::pair<const K, V>>& reference to the list
-    * @tparam int begin index
-    * @tparam int end index
-    * 
-    */
-    void balance(std::vector<std::pair<const K, V>>& list, int begin, int end);
+     * @brief The lookup of find(): the search, followed by the access of the balancing policy and by the
+     * check of the depth of the automatic rebalancing
+     * @param key the key, a K or a type compared with the keys by a transparent comparing function
+     * @return Node* the node with the key, nullptr if it is not present
+     */
+    template <class Q>
+    Node* locate(const Q& key);
+    /**
+     * @brief The lookups of find_batch(), a group of up to batch_width keys at a time
+     * 
+     * The searches of a group go down one level together: every search compares its key with the current node
+     * and prefetches the next one, then the other searches of the group do the same. The node of a search is
+     * already on its way from memory while the other ones are compared, so the misses of the group overlap
+     * instead of following one another.
+     * @tparam It the type of the iterators written, Iterator or ConstIterator
+     * @param keys_in the keys to be searched
+     * @param results_out where an iterator is written for every key, end() for the missing ones
+     * @return Out the output iterator past the last result
+     */
+    template <class It, class KeyRange, class Out>
+    Out lookup_batch(const KeyRange& keys_in, Out results_out) const;
+    /**
+     * @brief The lookup of co_find(), a coroutine that suspends after the prefetch of every next node
+     * @tparam It the type of the iterator written, Iterator or ConstIterator
+     * @param key the key to be searched
+     * @param result where the iterator is written when the coroutine ends
+     * @return interleave::task the coroutine, not started
+     */
+    template <class It, class Out>
+    interleave::task co_lookup(K key, Out result) const;
+    /**
+     * @brief The three-way comparison of a key with the key of a node
+     * @param key the key, a K or a type compared with the keys by a transparent comparing function
+     * @param k the key of the node
+     * @return int negative, zero or positive if key is less, equivalent or greater than k
+     */
+    template <class Q>
+    int compare(const Q& key, const K& k) const
+    {
+        // a single comparison if the comparing function has a three-way compare()
+        if constexpr (has_three_way<F,K,Q>::value)
+            return cmp.compare(key, k);
+        else
+            return cmp(key, k) ? -1 : cmp(k, key) ? 1 : 0;
+    }
+    /**
+     * @brief The node of the first key not less than the given one, without changing the tree
+     * @param key the key, a K or a type compared with the keys by a transparent comparing function
+     * @return Node* the node, nullptr if all the keys are less than the given one
+     */
+    template <class Q>
+    Node* lower_node(const Q& key) const
+    {
+        s_pair found = search(const_cast<Link&>(root), key, nullptr);
+        return found.first ? found.first.get() : found.second;
+    }
+
     /**
      * @brief An utility for the copy constructor
      * It starts a recursive copy of a BT starting from a given node(ideally the root).
      * @param old the node from which to start the copy. If is root then it copy an entire tree, else just a subtree
+     * @param copied the link where to put the copy
+     * @param parent the `_parent` of the copy, a node of the new tree
+     */
+    void copy_util(const BinaryTree::Node& old, Link& copied, Node* parent);
+    /**
+     * @brief An utility for assign(), it builds a perfectly balanced subtree from the next entries of a sorted range
+     * @param link the link where to put the subtree
+     * @param first iterator to the next entry, it is moved past the used ones
+     * @param count the number of entries in the subtree
+     */
+    template <class It>
+    void build(Link& link, It& first, std::size_t count);
+    /**
+     * @brief Allocates and constructs a node with the allocator of the tree
+     * @param key the key
+     * @param value the value
+     * @param parent the `_parent` of the node
+     * @return Link the link owning the new node
+     */
+    Link make_node(const K& key, const V& value, Node* parent);
+    /**
+     * @brief Frees all the nodes of a subtree, in constant stack space
+     * 
+     * The left children are rotated up until the top node has none, then it is freed and its right
+     * child takes its place: no recursion through the destructors of the links, whatever the shape.
+     * The visit is skipped when the allocator of the nodes releases its memory in bulk.
+     * @param link the link to the subtree, it is left empty
      */
-    void copy_util(const BinaryTree::Node& old, std::unique_ptr<Node>& copied);
+    void destroy(Link& link) noexcept;
+    /**
+     * @brief Frees a node without children, keeping it in the spare nodes if there is room
+     * @param link the link to the node, it is left empty
+     */
+    void recycle(Link& link) noexcept;
+    /** asks the processor to start loading a node, a null one is ignored */
+    static void prefetch(const Node* node) noexcept
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(node);
+#else
+        (void)node;
+#endif
+    }
  
     
-    using s_pair = std::pair<std::unique_ptr<typename BinaryTree<K,V,F>::Node>&,typename BinaryTree<K,V,F>::Node*>;
+    using s_pair = std::pair<Link&,typename BinaryTree<K,V,F,B,A>::Node*>;
     public:
 
     /**
      * @brief Construct a new Binary Tree object
      */
-    BinaryTree(F f = ::default_comparator): cmp{f} {};
+    BinaryTree(F f = ::make_default_comparator<F,K>(), B policy = B{}, const A& allocator = A{}): alloc{allocator}, balancer{policy}, cmp{f} {};
+    /**
+     * @brief Construct a perfectly balanced Binary Tree from a sorted range, see assign()
+     * 
+     * @param first iterator to the first entry
+     * @param last iterator past the last entry
+     * @param f the comparing function
+     * @param policy the balancing policy
+     * @param allocator the allocator of the nodes
+     */
+    template <class It>
+    BinaryTree(It first, It last, F f = ::make_default_comparator<F,K>(), B policy = B{}, const A& allocator = A{}): alloc{allocator}, balancer{policy}, cmp{f}
+    {
+        assign(first, last);
+    }
     /**
      * @brief Destroy the Binary Tree object
      * 
      */
-    ~BinaryTree() noexcept = default;
+    ~BinaryTree() noexcept {destroy(root); shrink_to_fit();}
     /**
      * @brief Creates a deep copy of a binary tree
      * 
      * @param bt the tree to be copied
      */
-    BinaryTree (const BinaryTree& bt) : cmp{bt.cmp} {this->copy_util(*bt.root, this->root);}
+    BinaryTree (const BinaryTree& bt) : BinaryTree(bt, A(node_traits::select_on_container_copy_construction(bt.alloc))) {}
+    /**
+     * @brief Creates a deep copy of a binary tree, whose nodes are allocated with the given allocator
+     * 
+     * @param bt the tree to be copied
+     * @param allocator the allocator of the copy
+     */
+    BinaryTree (const BinaryTree& bt, const A& allocator) : alloc{allocator}, tree_size{bt.tree_size}, balancer{bt.balancer}, cmp{bt.cmp},
+    depth_factor{bt.depth_factor}, deferred_balance{bt.deferred_balance}, balance_pending{bt.balance_pending}, depth_debt{bt.depth_debt}, stats{bt.stats}
+    {
+        fork_balancer(bt);
+        // the destructor does not run if a copy throws
+        try
+        {
+            if(bt.root != nullptr) this->copy_util(*bt.root, this->root, nullptr);
+        }
+        catch(...)
+        {
+            destroy(root);
+            throw;
+        }
+    }
     /**
      * @brief Copy assignement
      * 
@@ -128,8 +1167,25 @@ class BinaryTree
      * @return BinaryTree& 
      */
     BinaryTree& operator=(const BinaryTree& bt);
-    BinaryTree(BinaryTree&& bt) noexcept = default;
-    BinaryTree& operator=(BinaryTree&& bt) noexcept = default;
+    /**
+     * @brief Move constructor, the moved tree is left empty
+     * 
+     * @param bt the tree to be moved
+     */
+    BinaryTree(BinaryTree&& bt) noexcept : alloc{bt.alloc}, root{std::move(bt.root)}, tree_size{bt.tree_size}, balancer{std::move(bt.balancer)},
+    cmp{std::move(bt.cmp)}, depth_factor{bt.depth_factor}, deferred_balance{bt.deferred_balance}, balance_pending{bt.balance_pending}, depth_debt{bt.depth_debt}, stats{bt.stats},
+    spare{std::move(bt.spare)}, spare_limit{bt.spare_limit}, recycle_stats{bt.recycle_stats} {bt.tree_size = 0; bt.spare.clear();}
+    /**
+     * @brief Move assignment, the moved tree is left empty
+     * 
+     * The allocator is moved only if it propagates on move assignment. Otherwise, if the allocators are
+     * not equal, the nodes cannot be taken since they would be freed with the wrong allocator: the entries
+     * are copied one by one, as the standard containers do, and this can throw.
+     * 
+     * @param bt the tree to be moved
+     * @return BinaryTree& 
+     */
+    BinaryTree& operator=(BinaryTree&& bt) noexcept(node_traits::propagate_on_container_move_assignment::value || node_traits::is_always_equal::value);
 /**
  * @brief These functions works only if you deefine __TESTBTFUN__ and include "TestFunctions.h"
  * 
@@ -161,19 +1217,132 @@ class BinaryTree
 
 
     //clear the content of the tree
-    void clear() noexcept {root.reset();} 
+    void clear() noexcept {destroy(root); tree_size = 0;} 
+
+    /**
+     * @brief Replaces the content of the tree with a sorted range of entries
+     * 
+     * The tree is built perfectly balanced in O(n) time, taking every time the middle entry as root, without
+     * comparing any key. The range must be sorted according to the comparing function and have no duplicated
+     * keys: this is checked only in the debug builds (without NDEBUG).
+     * 
+     * @param first forward iterator to the first entry, e.g. the iterators of another tree
+     * @param last iterator past the last entry
+     */
+    template <class It>
+    void assign(It first, It last);
+
+    /**
+     * @brief The number of elements in the tree
+     * 
+     * @return std::size_t the number of nodes
+     */
+    std::size_t size() const noexcept {return tree_size;}
 
     /**
     * @brief function that balance the tree
     * 
     * 
-    * Calling this function the tree will be balanced. The underlying algorithm consists in extracting the list of
-    * all pairs (key,value) of the current tree, clearing the current tree, and then inserting all the pairs in such
-    * an order that the tree will balanced.
+    * Calling this function the tree will be balanced. The existing nodes are relinked in place in a complete tree
+    * (see balancing::rebuild()) in linear time: no entry is copied and no node is allocated or freed.
+    * The balancing policy then sets again the data of the nodes.
     *
     */
     void balance();
 
+    /**
+     * @brief Moves the nodes next to each other in memory, in the given order
+     * 
+     * After many insertions the nodes are scattered over the heap, and balance() relinks them where they are.
+     * This allocates a new node for every entry, in the given order and without taking the spare nodes (see
+     * reserve()), links the copies in the same shape and frees the old nodes. The new nodes are contiguous
+     * when the allocator hands out consecutive memory, as a node_pool or a monotonic_buffer_resource do, and
+     * usually as malloc does for a burst of allocations of the same size. It can run after balance() or on its own.
+     * The iterators and the references to the entries are invalidated.
+     * 
+     * @param layout the order of the nodes in memory (default order::pre_order)
+     */
+    void compact(order layout = order::pre_order);
+
+    /**
+     * @brief Enables the automatic rebalancing, driven by the depth reached by the searches
+     * 
+     * Every find() and insert() compares the depth it reached with factor*log2(size). The levels visited beyond
+     * it are summed up, and when they add up to the size of the tree, that is to the cost of a rebuild, the tree is
+     * balanced: a degenerate tree is rebuilt at its first deep search, while a few unlucky searches in a random tree
+     * do not trigger anything. The counters() tell how many rebuilds happened and what they cost.
+     * 
+     * @param factor the allowed depth in units of log2(size), 0 disables the automatic rebalancing (the default)
+     * @param deferred if true the rebuild is not done during the search, but at the next call of idle()
+     */
+    void auto_balance(double factor, bool deferred = false) noexcept {depth_factor = factor; deferred_balance = deferred;}
+
+    /**
+     * @brief Runs the rebuild deferred by the automatic rebalancing, if there is one
+     * 
+     * It is meant to be called when the application is idle, e.g. from the idle callback of an event loop.
+     * 
+     * @return true if the tree was rebuilt
+     */
+    bool idle();
+
+    /**
+     * @brief The counters of the automatic rebalancing
+     * 
+     * @return const balance_counters& the number of rebuilds, their cost and the maximum depth observed
+     */
+    const balance_counters& counters() const noexcept {return stats;}
+
+    /**
+     * @brief The allocator of the nodes
+     * 
+     * @return A a copy of the allocator
+     */
+    A get_allocator() const noexcept {return A(alloc);}
+
+    /**
+     * @brief Prepares the tree to hold n entries without allocating
+     * 
+     * The missing nodes are allocated at once and kept in a free list, which is also capped at n nodes: from now
+     * on the nodes freed by clear(), assign() or an assignment go back in the list (up to the cap) instead of
+     * the allocator, and insert() and the copies take their nodes from it. A tree that is cleared and filled
+     * again in a loop then allocates only in the first round.
+     * 
+     * @param n the number of entries
+     */
+    void reserve(std::size_t n);
+
+    /**
+     * @brief Gives the spare nodes back to the allocator and disables the recycling, until the next reserve()
+     */
+    void shrink_to_fit() noexcept;
+
+    /**
+     * @brief The counters of the recycling of the nodes
+     * 
+     * @return const recycle_counters& the number of reused and allocated nodes, and the hit rate of the free list
+     */
+    const recycle_counters& recycling() const noexcept {return recycle_stats;}
+
+    /**
+     * @brief The memory used by the tree, besides the tree object itself
+     * 
+     * The overhead of the allocator for every node is estimated by allocation_overhead().
+     * 
+     * @return memory_footprint the number of nodes, their bytes, the slack and the bytes per entry
+     */
+    memory_footprint memory_usage() const noexcept;
+
+    /**
+     * @brief Creates a read-only copy of the tree laid out for fast lookups
+     * 
+     * The entries are copied in a FrozenTree, in breadth-first (Eytzinger) order in a contiguous array.
+     * This function works only if you include "FrozenTree.h".
+     * 
+     * @return FrozenTree<K,V,F> the frozen copy, independent from this tree
+     */
+    FrozenTree<K,V,F> freeze() const;
+
     /**
     * @brief operator that return the value corresponding to a given key
     * 
@@ -256,11 +1425,110 @@ class BinaryTree
      * @param key the key of the node to be searched
      * @return Iterator an Iterator to the node with the key or to end() if its not present  
      */
-    Iterator find(const K& key)
-    {
-        Iterator it = Iterator(search(root,key,nullptr).first.get());
-        return it;
-    }
+    Iterator find(const K& key) {return Iterator{locate(key)};}
+    /**
+     * @brief Finds a value with a key equivalent to the given object, without building a key
+     * 
+     * It takes part in the overload resolution only if the comparing function is transparent (it defines
+     * is_transparent, like default_less<>), and the object can be anything the comparing function compares with the keys.
+     * @param key the object compared with the keys, e.g. a std::string_view or a const char* for std::string keys
+     * @return Iterator an Iterator to the node with the key or to end() if its not present
+     */
+    template <class Q, class G = F, class = typename G::is_transparent>
+    Iterator find(const Q& key) {return Iterator{locate(key)};}
+    /**
+     * @brief Finds many keys at once, faster than calling find() for each of them on a tree larger than the cache
+     * 
+     * The keys are searched in groups of batch_width walked together (group prefetching), so that the cache
+     * misses of the different searches overlap. Unlike find() it never changes the tree: no splaying and no
+     * automatic rebalancing.
+     * @param keys_in a range of keys, e.g. a std::vector<K>
+     * @param results_out an output iterator, an Iterator is written for every key in the same order (end() if it is not present)
+     * @return Out the output iterator past the last result
+     */
+    template <class KeyRange, class Out>
+    Out find_batch(const KeyRange& keys_in, Out results_out) {return lookup_batch<Iterator>(keys_in, results_out);}
+    /**
+     * @brief Same as find_batch() but for a constant tree, a ConstIterator is written for every key
+     * @param keys_in a range of keys
+     * @param results_out an output iterator
+     * @return Out the output iterator past the last result
+     */
+    template <class KeyRange, class Out>
+    Out find_batch(const KeyRange& keys_in, Out results_out) const {return lookup_batch<ConstIterator>(keys_in, results_out);}
+    /**
+     * @brief Finds a key in a coroutine, to be run by an interleave::scheduler together with other ones
+     * 
+     * The coroutine descends like find() but, after the prefetch of every next node, it suspends: the scheduler
+     * runs the other lookups (or any other coroutine) while the node comes from memory. Like find_batch() it
+     * never changes the tree. The tree must not be modified nor destroyed until the coroutine is done.
+     * This function works only if you include "Interleave.h".
+     * @param key the key to be searched, it is copied in the coroutine
+     * @param result an output iterator (e.g. a pointer to an Iterator), where the result is written at the end
+     * @return interleave::task the coroutine, not started
+     */
+    template <class Out>
+    interleave::task co_find(K key, Out result);
+    /**
+     * @brief Same as co_find() but for a constant tree, a ConstIterator is written at the end
+     * @param key the key to be searched, it is copied in the coroutine
+     * @param result an output iterator, where the result is written at the end
+     * @return interleave::task the coroutine, not started
+     */
+    template <class Out>
+    interleave::task co_find(K key, Out result) const;
+    /**
+     * @brief The number of elements with a given key, 0 or 1; unlike find() it never changes the tree
+     * @param key the key to be searched
+     * @return std::size_t 1 if the key is present, 0 otherwise
+     */
+    std::size_t count(const K& key) const {return contains(key) ? 1 : 0;}
+    /**
+     * @brief The number of elements with a key equivalent to the given object, for a transparent comparing function
+     * @param key the object compared with the keys
+     * @return std::size_t 1 if there is such a key, 0 otherwise
+     */
+    template <class Q, class G = F, class = typename G::is_transparent>
+    std::size_t count(const Q& key) const {return contains(key) ? 1 : 0;}
+    /**
+     * @brief Tells if a key is present; unlike find() it never changes the tree
+     * @param key the key to be searched
+     * @return true if the key is present
+     */
+    bool contains(const K& key) const {return search(const_cast<Link&>(root), key, nullptr).first != nullptr;}
+    /**
+     * @brief Tells if there is a key equivalent to the given object, for a transparent comparing function
+     * @param key the object compared with the keys
+     * @return true if there is such a key
+     */
+    template <class Q, class G = F, class = typename G::is_transparent>
+    bool contains(const Q& key) const {return search(const_cast<Link&>(root), key, nullptr).first != nullptr;}
+    /**
+     * @brief The first element with a key not less than the given one; it never changes the tree
+     * @param key the key to be searched
+     * @return Iterator an Iterator to the element, or end() if all the keys are less than the given one
+     */
+    Iterator lower_bound(const K& key) {return Iterator{lower_node(key)};}
+    /**
+     * @brief Same as lower_bound() but for a constant tree
+     * @param key the key to be searched
+     * @return ConstIterator a constant iterator to the element, or end() if all the keys are less than the given one
+     */
+    ConstIterator lower_bound(const K& key) const {return ConstIterator{lower_node(key)};}
+    /**
+     * @brief The first element with a key not less than the given object, for a transparent comparing function
+     * @param key the object compared with the keys
+     * @return Iterator an Iterator to the element, or end() if all the keys are less than the object
+     */
+    template <class Q, class G = F, class = typename G::is_transparent>
+    Iterator lower_bound(const Q& key) {return Iterator{lower_node(key)};}
+    /**
+     * @brief Same as lower_bound() but for a constant tree
+     * @param key the object compared with the keys
+     * @return ConstIterator a constant iterator to the element, or end() if all the keys are less than the object
+     */
+    template <class Q, class G = F, class = typename G::is_transparent>
+    ConstIterator lower_bound(const Q& key) const {return ConstIterator{lower_node(key)};}
     /**
      * @brief Insert a new node with given key and value
      * It returns a std::pair with an iterator to the node and a bool. If the key is not present, the new node is effectively added and the bool as value true. In case
@@ -278,21 +1546,39 @@ class BinaryTree
      */
     std::pair<Iterator,bool> insert (std::pair<const K&, const V&> p) {return insert(p.first,p.second);}
     
-    template <class k,class v, class f> 
+    /**
+     * @brief Moves the elements with a key not less than the given one in a new tree
+     * 
+     * It needs a balancing policy that supports splitting (balancing::treap), the cost is O(log n) expected time.
+     * 
+     * @param key the key where to split
+     * @return BinaryTree the tree with the keys not less than key, this tree keeps the smaller ones
+     */
+    BinaryTree split(const K& key);
+    /**
+     * @brief Moves all the elements of another tree in this one
+     * 
+     * It needs a balancing policy that supports joining (balancing::treap), the cost is O(log n) expected time.
+     * @throws std::invalid_argument if the keys of the other tree are not all greater than the ones of this tree
+     * @param other the tree to be joined, it is left empty
+     */
+    void join(BinaryTree&& other);
+
+    template <class k,class v, class f, class b, class a> 
     /**
      * @brief Overloading of the operator<< for printing and writing on files
      * 
      * @return std::ostream& 
      */
-    friend std::ostream& operator<<(std::ostream&, const BinaryTree<k,v,f>&);
+    friend std::ostream& operator<<(std::ostream&, const BinaryTree<k,v,f,b,a>&);
 
    
 };
 
-template <class K, class V, class F>
-class BinaryTree<K,V,F>::Iterator : public std::iterator<std::forward_iterator_tag,std::pair<const K, V>>
+template <class K, class V, class F, class B, class A>
+class BinaryTree<K,V,F,B,A>::Iterator : public std::iterator<std::forward_iterator_tag,std::pair<const K, V>>
 {
-    using Node = BinaryTree<K,V,F>::Node;
+    using Node = BinaryTree<K,V,F,B,A>::Node;
     Node* pointed;
 
     public:
@@ -312,8 +1598,8 @@ class BinaryTree<K,V,F>::Iterator : public std::iterator<std::forward_iterator_t
 
 };
 
-template <class K, class V, class F>
-typename BinaryTree<K,V,F>::Iterator& BinaryTree<K,V,F>::Iterator::operator++()
+template <class K, class V, class F, class B, class A>
+typename BinaryTree<K,V,F,B,A>::Iterator& BinaryTree<K,V,F,B,A>::Iterator::operator++()
 {
     // when you can go right
     if(pointed->_right != nullptr)
@@ -330,85 +1616,532 @@ typename BinaryTree<K,V,F>::Iterator& BinaryTree<K,V,F>::Iterator::operator++()
     return (*this);
 }
 
-template <class K, class V, class F>
-typename BinaryTree<K,V,F>::Node* BinaryTree<K,V,F>::first_node() const noexcept
+template <class K, class V, class F, class B, class A>
+typename BinaryTree<K,V,F,B,A>::Node* BinaryTree<K,V,F,B,A>::first_node() const noexcept
 {
     Node* node = root.get();
-    //find the leftmost node
-    while(node->_left != nullptr)
+    //find the leftmost node (an empty tree has no first node)
+    while(node != nullptr && node->_left != nullptr)
         node = node->_left.get();
     return node;
 }
 
-template <class K, class V, class F>
-class BinaryTree<K,V,F>::ConstIterator : public BinaryTree<K,V,F>::Iterator
+template <class K, class V, class F, class B, class A>
+class BinaryTree<K,V,F,B,A>::ConstIterator : public BinaryTree<K,V,F,B,A>::Iterator
 { 
     public:
-        using non_const_it = BinaryTree<K,V,F>::Iterator;
+        using non_const_it = BinaryTree<K,V,F,B,A>::Iterator;
         using non_const_it::Iterator;
         const std::pair<const K, V>& operator*() const {return non_const_it::operator*(); }
 };
 
-template <class K, class V, class F>
-void BinaryTree<K,V,F>::copy_util(const BinaryTree::Node& old, std::unique_ptr<BinaryTree::Node>& copied )
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::copy_util(const BinaryTree::Node& old, Link& copied, Node* parent)
 {
-    copied.reset(new Node(old.entry.first, old.entry.second, old._parent));
+    copied = make_node(old.entry.first, old.entry.second, parent);
+    // the balancing informations (color, height, ...) are copied as they are
+    static_cast<typename B::node_data&>(*copied) = old;
+    // the left child goes back to the copied node, the right one to our parent
     if(old._left != nullptr)
-        copy_util(*old._left, copied->_left);
+        copy_util(*old._left, copied->_left, copied.get());
     if(old._right != nullptr)
-        copy_util(*old._right, copied->_right);
+        copy_util(*old._right, copied->_right, parent);
 }
 
-template <class K, class V, class F>
-BinaryTree<K,V,F>& BinaryTree<K,V,F>::operator=(const BinaryTree& bt)
+template <class K, class V, class F, class B, class A>
+typename BinaryTree<K,V,F,B,A>::Link BinaryTree<K,V,F,B,A>::make_node(const K& key, const V& value, Node* parent)
+{
+    Node* node;
+    if(!spare.empty())
+    {
+        node = spare.back();
+        spare.pop_back();
+        ++recycle_stats.reused;
+    }
+    else
+    {
+        node = node_traits::allocate(alloc, 1);
+        ++recycle_stats.allocated;
+    }
+    try
+    {
+        node_traits::construct(alloc, node, key, value, parent);
+    }
+    catch(...)
+    {
+        // the room for it is there, since it was just taken
+        if(spare.size() < spare_limit)
+            spare.push_back(node);
+        else
+            node_traits::deallocate(alloc, node, 1);
+        throw;
+    }
+    return Link{node};
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::destroy(Link& link) noexcept
+{
+    // nothing to run on the nodes, and nothing to give back one by one
+    if constexpr (std::is_trivially_destructible<std::pair<const K, V>>::value &&
+                  std::is_trivially_destructible<typename B::node_data>::value &&
+                  std::is_trivially_destructible<node_allocator>::value)
+    {
+        if(releases_in_bulk(alloc))
+        {
+            link.release();
+            return;
+        }
+    }
+    while(link != nullptr)
+    {
+        if(link->_left != nullptr)
+        {
+            // right rotation, without fixing the successors since the nodes are going away
+            Link left = std::move(link->_left);
+            link->_left = std::move(left->_right);
+            left->_right = std::move(link);
+            link = std::move(left);
+        }
+        else
+        {
+            // the right subtree is taken out before the node is freed
+            Link right = std::move(link->_right);
+            recycle(link);
+            link = std::move(right);
+        }
+    }
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::recycle(Link& link) noexcept
+{
+    Node* node = link.release();
+    node_traits::destroy(alloc, node);
+    if(spare.size() < spare_limit)
+        spare.push_back(node);
+    else
+        node_traits::deallocate(alloc, node, 1);
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::reserve(std::size_t n)
+{
+    // the pushes in recycle() must not allocate
+    spare.reserve(n);
+    spare_limit = std::max(spare_limit, n);
+    while(tree_size + spare.size() < n)
+        spare.push_back(node_traits::allocate(alloc, 1));
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::compact(order layout)
+{
+    if(root == nullptr) return;
+    // a node and where it goes: the left or right child of a node visited before it
+    struct visit
+    {
+        const Node* node;
+        std::size_t parent;
+        bool left;
+    };
+    std::vector<visit> visits;
+    visits.reserve(tree_size);
+    if(layout == order::breadth_first)
+    {
+        visits.push_back(visit{root.get(), 0, false});
+        for(std::size_t i = 0; i < visits.size(); ++i)
+        {
+            const Node* node = visits[i].node;
+            if(node->_left != nullptr) visits.push_back(visit{node->_left.get(), i, true});
+            if(node->_right != nullptr) visits.push_back(visit{node->_right.get(), i, false});
+        }
+    }
+    else
+    {
+        std::vector<visit> pending{visit{root.get(), 0, false}};
+        while(!pending.empty())
+        {
+            visits.push_back(pending.back());
+            pending.pop_back();
+            const std::size_t i = visits.size() - 1;
+            const Node* node = visits[i].node;
+            if(node->_right != nullptr) pending.push_back(visit{node->_right.get(), i, false});
+            if(node->_left != nullptr) pending.push_back(visit{node->_left.get(), i, true});
+        }
+    }
+
+    // the parents are copied first, so the copy is always a tree and the old one is untouched until the end
+    std::vector<Node*> copies(visits.size());
+    Link copied_root;
+    try
+    {
+        for(std::size_t i = 0; i < visits.size(); ++i)
+        {
+            const visit& v = visits[i];
+            // a left child is followed by its parent, a right one by the successor of its parent
+            Node* successor = i == 0 ? nullptr : v.left ? copies[v.parent] : copies[v.parent]->_parent;
+            Node* node = node_traits::allocate(alloc, 1);
+            try
+            {
+                node_traits::construct(alloc, node, v.node->entry.first, v.node->entry.second, successor);
+            }
+            catch(...)
+            {
+                node_traits::deallocate(alloc, node, 1);
+                throw;
+            }
+            static_cast<typename B::node_data&>(*node) = *v.node;
+            copies[i] = node;
+            Link link{node};
+            if(i == 0)
+                copied_root = std::move(link);
+            else if(v.left)
+                copies[v.parent]->_left = std::move(link);
+            else
+                copies[v.parent]->_right = std::move(link);
+        }
+    }
+    catch(...)
+    {
+        destroy(copied_root);
+        throw;
+    }
+    destroy(root);
+    root = std::move(copied_root);
+}
+
+template <class K, class V, class F, class B, class A>
+typename BinaryTree<K,V,F,B,A>::memory_footprint BinaryTree<K,V,F,B,A>::memory_usage() const noexcept
+{
+    memory_footprint usage;
+    const std::size_t overhead = allocation_overhead(alloc, sizeof(Node));
+    usage.nodes = tree_size;
+    usage.node_bytes = tree_size*sizeof(Node);
+    usage.slack = tree_size*overhead + spare.size()*(sizeof(Node) + overhead)
+                + spare.capacity()*sizeof(Node*) + path.capacity()*sizeof(Link*);
+    return usage;
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::shrink_to_fit() noexcept
+{
+    for(Node* node : spare)
+        node_traits::deallocate(alloc, node, 1);
+    spare.clear();
+    spare.shrink_to_fit();
+    spare_limit = 0;
+}
+
+template <class K, class V, class F, class B, class A>
+template <class It>
+void BinaryTree<K,V,F,B,A>::build(Link& link, It& first, std::size_t count)
+{
+    if(count == 0) return;
+    const std::size_t left = (count - 1)/2;
+    // the left subtree is not linked yet, so it is freed here if a construction throws; the rest is freed by assign()
+    Link left_tree;
+    try
+    {
+        build(left_tree, first, left);
+        // the nodes on the right spine of the subtree get their successor later, from the caller
+        link = make_node((*first).first, (*first).second, nullptr);
+    }
+    catch(...)
+    {
+        destroy(left_tree);
+        throw;
+    }
+    ++first;
+    // the nodes on the right spine of the left subtree are followed by the new one
+    for(Node* node = left_tree.get(); node != nullptr; node = node->_right.get())
+        node->_parent = link.get();
+    link->_left = std::move(left_tree);
+    build(link->_right, first, count - 1 - left);
+}
+
+template <class K, class V, class F, class B, class A>
+template <class It>
+void BinaryTree<K,V,F,B,A>::assign(It first, It last)
+{
+    clear();
+    const std::size_t count = std::size_t(std::distance(first, last));
+#ifndef NDEBUG
+    for(It it = first, next = first; it != last && ++next != last; ++it)
+        assert(cmp((*it).first, (*next).first) && "the range must be sorted and have no duplicated keys");
+#endif
+    try
+    {
+        build(root, first, count);
+    }
+    catch(...)
+    {
+        destroy(root);
+        throw;
+    }
+    tree_size = count;
+    std::size_t height = 0;
+    while((std::size_t(1) << height) - 1 < count)
+        ++height;
+    balancer.rebuilt(root, height);
+}
+
+template <class K, class V, class F, class B, class A>
+BinaryTree<K,V,F,B,A>& BinaryTree<K,V,F,B,A>::operator=(const BinaryTree& bt)
+{
+    if(this == &bt) return *this;
+    destroy(root);
+    tree_size = 0;
+    if constexpr (node_traits::propagate_on_container_copy_assignment::value)
+    {
+        if(!(alloc == bt.alloc))
+        {
+            BinaryTree tmp{bt, A(bt.alloc)};
+            (*this) = std::move(tmp);
+            return *this;
+        }
+    }
+    // the copy is made in place, so that it takes the spare nodes
+    try
+    {
+        if(bt.root != nullptr) copy_util(*bt.root, root, nullptr);
+    }
+    catch(...)
+    {
+        destroy(root);
+        throw;
+    }
+    tree_size = bt.tree_size;
+    balancer = bt.balancer;
+    fork_balancer(bt);
+    cmp = bt.cmp;
+    depth_factor = bt.depth_factor;
+    deferred_balance = bt.deferred_balance;
+    balance_pending = bt.balance_pending;
+    depth_debt = bt.depth_debt;
+    stats = bt.stats;
+    return *this;
+}
+
+template <class K, class V, class F, class B, class A>
+BinaryTree<K,V,F,B,A>& BinaryTree<K,V,F,B,A>::operator=(BinaryTree&& bt) noexcept(node_traits::propagate_on_container_move_assignment::value || node_traits::is_always_equal::value)
 {
-    root.reset();
-    auto tmp = bt;
-    (*this) = std::move(tmp);
+    if(this == &bt) return *this;
+    destroy(root);
+    tree_size = 0;
+    if constexpr (node_traits::propagate_on_container_move_assignment::value)
+    {
+        // the spare nodes go back to the allocator they come from
+        if(!(alloc == bt.alloc))
+            shrink_to_fit();
+        alloc = bt.alloc;
+    }
+    if(alloc == bt.alloc)
+        root = std::move(bt.root);
+    else
+    {
+        // every node of a tree comes from its allocator, so the entries are copied in new nodes
+        try
+        {
+            if(bt.root != nullptr) copy_util(*bt.root, root, nullptr);
+        }
+        catch(...)
+        {
+            destroy(root);
+            throw;
+        }
+        bt.destroy(bt.root);
+    }
+    tree_size = bt.tree_size;
+    bt.tree_size = 0;
+    balancer = std::move(bt.balancer);
+    cmp = std::move(bt.cmp);
+    depth_factor = bt.depth_factor;
+    deferred_balance = bt.deferred_balance;
+    balance_pending = bt.balance_pending;
+    depth_debt = bt.depth_debt;
+    stats = bt.stats;
     return *this;
 }
 
-template <class K, class V,class F>
-std::pair<typename BinaryTree<K,V,F>::Iterator,bool> BinaryTree<K,V,F>::insert(const K& key, const V& value)
+template <class K, class V, class F, class B, class A>
+std::pair<typename BinaryTree<K,V,F,B,A>::Iterator,bool> BinaryTree<K,V,F,B,A>::insert(const K& key, const V& value)
 {
-    BinaryTree<K, V, F>::s_pair node_pair = search(root,key,nullptr);
+    // the path is recorded only if the balancing policy needs it
+    link_path* trace = B::records_path ? &path : nullptr;
+    if(trace) trace->clear();
+    // the level of the node, counted only if the automatic rebalancing needs it
+    std::size_t depth = 1;
+    BinaryTree<K,V,F,B,A>::s_pair node_pair = search(root,key,nullptr,trace,depth_factor > 0 ? &depth : nullptr);
     // Look if the key is already present and update the second return value
     bool modified = node_pair.first ==nullptr;
     // if not present insert the new node
-    if(modified) node_pair.first.reset(new Node(key,value,node_pair.second));
-    return std::pair<Iterator,bool>{Iterator{node_pair.first.get()},modified};
+    if(modified)
+    {
+        node_pair.first = make_node(key,value,node_pair.second);
+        ++tree_size;
+    }
+    // the rebalancing moves the links around but not the nodes
+    Node* node = node_pair.first.get();
+    if(modified && trace) balancer.inserted(path.data(), path.size(), tree_size);
+    if constexpr (B::records_access)
+        if(!modified) balancer.accessed(path.data(), path.size());
+    if(depth_factor > 0) observe(depth);
+    return std::pair<Iterator,bool>{Iterator{node},modified};
 }
 
-template <class K, class V,class F>
-typename BinaryTree<K, V, F>::s_pair BinaryTree<K,V,F>::search (std::unique_ptr<typename BinaryTree<K,V,F>::Node>& node, const K& key, typename BinaryTree<K,V,F>::Node* old) const
+template <class K, class V, class F, class B, class A>
+template <class Q>
+typename BinaryTree<K,V,F,B,A>::s_pair BinaryTree<K,V,F,B,A>::search (Link& node, const Q& key, typename BinaryTree<K,V,F,B,A>::Node* old, link_path* trace, std::size_t* depth) const
 {
-    //stop when the key is present or we have reached the right insertion node
-    if(node == nullptr || (!cmp(node->entry.first,key) && !cmp(key,node->entry.first)) )
-        return BinaryTree<K, V, F>::s_pair{node,old};       
-    else 
+    Link* link = &node;
+    while(true)
+    {
+        if(trace) trace->push_back(link);
+        Node* current = link->get();
+        //stop when we have reached the right insertion node
+        if(current == nullptr) break;
+        // the next node is one of the two, both are requested while the keys are compared
+        prefetch(current->_left.get());
+        prefetch(current->_right.get());
+        const int order = compare(key, current->entry.first);
+        if(order < 0)
+        {
+            old = current;
+            link = &current->_left;
+        }
         //if we are on a right node, our parent is our father parent
-        return cmp(node->entry.first, key) ? search(node->_right,key, node->_parent) : search(node->_left,key, node.get());
+        else if(order > 0)
+        {
+            old = current->_parent;
+            link = &current->_right;
+        }
+        //or when the key is present
+        else
+            break;
+        if(depth) ++*depth;
+    }
+    return BinaryTree<K,V,F,B,A>::s_pair{*link,old};
 }
 
-template <class K, class V, class F>
-V& BinaryTree<K,V,F>::operator[](const K& key)  
+template <class K, class V, class F, class B, class A>
+template <class It, class KeyRange, class Out>
+Out BinaryTree<K,V,F,B,A>::lookup_batch(const KeyRange& keys_in, Out results_out) const
+{
+    auto key = std::begin(keys_in);
+    const auto last = std::end(keys_in);
+    // the keys of the group, the node every search has reached (nullptr when it is over) and the found ones
+    decltype(key) group[batch_width];
+    Node* current[batch_width];
+    Node* found[batch_width];
+    while(key != last)
+    {
+        std::size_t count = 0;
+        for(; count < batch_width && key != last; ++count, ++key)
+        {
+            group[count] = key;
+            current[count] = root.get();
+            found[count] = nullptr;
+        }
+        for(bool active = true; active; )
+        {
+            active = false;
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                Node* node = current[i];
+                if(node == nullptr) continue;
+                const int order = compare(*group[i], node->entry.first);
+                Node* next = order < 0 ? node->_left.get() : node->_right.get();
+                if(order == 0)
+                {
+                    found[i] = node;
+                    next = nullptr;
+                }
+                // the load of the next node overlaps with the other searches of the group
+                prefetch(next);
+                current[i] = next;
+                active = active || next != nullptr;
+            }
+        }
+        for(std::size_t i = 0; i < count; ++i)
+            *results_out++ = It{found[i]};
+    }
+    return results_out;
+}
+
+template <class K, class V, class F, class B, class A>
+template <class Q>
+typename BinaryTree<K,V,F,B,A>::Node* BinaryTree<K,V,F,B,A>::locate(const Q& key)
+{
+    std::size_t depth = 1;
+    std::size_t* counted = depth_factor > 0 ? &depth : nullptr;
+    if constexpr (B::records_access)
+    {
+        // the policy can move the found node, but the node itself stays where it is
+        path.clear();
+        Node* node = search(root,key,nullptr,&path,counted).first.get();
+        balancer.accessed(path.data(), path.size());
+        if(counted) observe(depth);
+        return node;
+    }
+    else
+    {
+        Node* node = search(root,key,nullptr,nullptr,counted).first.get();
+        if(counted) observe(depth);
+        return node;
+    }
+}
+
+template <class K, class V, class F, class B, class A>
+V& BinaryTree<K,V,F,B,A>::operator[](const K& key)  
 {
     Iterator s_res = find(key);
     if(s_res != end()) return (*s_res).second;
     return (*insert(key, V{}).first).second;
 }
 
-template <class K, class V, class F>
-const V& BinaryTree<K,V,F>::operator[](const K& key)  const
+template <class K, class V, class F, class B, class A>
+const V& BinaryTree<K,V,F,B,A>::operator[](const K& key)  const
 {
-    Iterator s_res = find(key);
-    if(s_res != end()) return (*s_res).second;
+    // a constant lookup does not splay nor count the depth
+    const Node* node = search(const_cast<Link&>(root), key, nullptr).first.get();
+    if(node != nullptr) return node->entry.second;
     //is a constant method, if it does not find the key it throws an exception
     throw std::runtime_error("You are trying to acces a non existing key");
 }
 
-template <class k,class v, class f> 
-std::ostream& operator<<(std::ostream& os, const BinaryTree<k,v,f>& bt)
+template <class K, class V, class F, class B, class A>
+BinaryTree<K,V,F,B,A> BinaryTree<K,V,F,B,A>::split(const K& key)
+{
+    BinaryTree<K,V,F,B,A> other{cmp, balancer, A(alloc)};
+    other.fork_balancer(*this);
+    balancer.split(root, key, cmp, other.root);
+    // the sizes are stored in the roots
+    tree_size = root ? root->size : 0;
+    other.tree_size = other.root ? other.root->size : 0;
+    return other;
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::join(BinaryTree&& other)
+{
+    if(root != nullptr && other.root != nullptr)
+    {
+        Node* last = root.get();
+        while(last->_right != nullptr)
+            last = last->_right.get();
+        if(!cmp(last->entry.first, other.first_node()->entry.first))
+            throw std::invalid_argument("The joined tree must contain only greater keys");
+    }
+    if(alloc != other.alloc)
+        throw std::invalid_argument("The joined tree must use the same allocator");
+    balancer.join(root, std::move(other.root));
+    tree_size += other.tree_size;
+    other.tree_size = 0;
+}
+
+template <class k,class v, class f, class b, class a> 
+std::ostream& operator<<(std::ostream& os, const BinaryTree<k,v,f,b,a>& bt)
 {
     for(const auto& vals : bt )
         os << "(" << vals.first << ":" << vals.second << ") ";
@@ -416,24 +2149,60 @@ std::ostream& operator<<(std::ostream& os, const BinaryTree<k,v,f>& bt)
     return os;
 }
 
-template <class K, class V, class F>
-void BinaryTree<K,V,F>::balance()
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::balance()
 {
-	if(root == nullptr) return;
-    std::vector<std::pair<const K, V>> list(begin(), end());
-    //free some space
-    clear();
-	balance(list, 0, int(list.size()) - 1);
+    const std::size_t height = balancing::rebuild(root, tree_size);
+    balancer.rebuilt(root, height);
+    // the debt of the old shape is paid
+    depth_debt = 0;
+    balance_pending = false;
+    stats.max_depth = height;
 }
 
-template <class K, class V, class F>
-void BinaryTree<K,V,F>::balance(std::vector<std::pair<const K, V>>& list, int begin,int end)
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::observe(std::size_t depth)
+{
+    stats.max_depth = std::max(stats.max_depth, depth);
+    // floor(log2(size + 1)) with a few shifts
+    std::size_t levels = 0;
+    for(std::size_t n = (tree_size + 1) >> 1; n != 0; n >>= 1)
+        ++levels;
+    const std::size_t allowed = std::size_t(depth_factor*double(levels)) + 1;
+    if(depth <= allowed) return;
+    depth_debt += depth - allowed;
+    if(depth_debt < tree_size || balance_pending) return;
+    if(deferred_balance)
+        balance_pending = true;
+    else
+        auto_rebuild();
+}
+
+template <class K, class V, class F, class B, class A>
+void BinaryTree<K,V,F,B,A>::auto_rebuild()
+{
+    const auto start = std::chrono::steady_clock::now();
+    balance();
+    stats.time += std::chrono::steady_clock::now() - start;
+    ++stats.rebuilds;
+    stats.relinked_nodes += tree_size;
+}
+
+template <class K, class V, class F, class B, class A>
+bool BinaryTree<K,V,F,B,A>::idle()
+{
+    if(!balance_pending) return false;
+    auto_rebuild();
+    return true;
+}
+
+namespace pmr
 {
-    if(begin > end) return;
-    int middle = begin + (end - begin)/2;
-    //int middle = (begin + end)/2;
-    insert(list[middle].first, list[middle].second);
-    //halve the list and do the same till the end
-    balance(list, begin, middle - 1);
-    balance(list, middle + 1, end);
+/**
+ * @brief A BinaryTree whose nodes are allocated from a std::pmr::memory_resource, e.g. a node_pool
+ */
+template <class K, class V, class F = ::default_less<K>, class B = balancing::none>
+using BinaryTree = ::BinaryTree<K, V, F, B, std::pmr::polymorphic_allocator<std::pair<const K, V>>>;
 }
+
+#endif
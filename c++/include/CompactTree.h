@@ -0,0 +1,557 @@
+/**
+ * @file CompactTree.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Red-black tree stored in a vector and linked with 32-bit indices
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __COMPACTTREE__
+#define __COMPACTTREE__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "BinaryTreeRec.h"
+
+/**
+ * @brief Class that implements a red-black tree with compact nodes and the same interface of BinaryTree
+ *
+ * All the nodes are kept in a single vector, in insertion order, and they are linked by their 32-bit positions
+ * instead of 64-bit pointers. As in BinaryTree, a node knows its children and its in-order successor between the
+ * ancestors (the `_parent` of BinaryTree), which is used by the iterators; the color of the node is stored in the
+ * highest bit of the successor index. For `<int,double>` a node takes 32 bytes instead of the 40 (plus the
+ * bookkeeping of the heap) of a BinaryTree node, and there is no allocation apart from the growth of the vector.
+ * The tree is kept balanced by the red-black rules, as with balancing::red_black.
+ *
+ * With SplitValues the nodes hold only a copy of the key and the links, and the entries are kept in a
+ * parallel vector (the entry of a node has the same position). A search then walks on small nodes and
+ * touches the memory of the values just once, at the end: this pays off when V is much larger than K.
+ *
+ * The iterators hold the tree and the position of the node, so they stay valid after an insertion as in
+ * BinaryTree (but not after the tree is moved). The references to the entries are invalidated when the vector
+ * grows, unless enough space was reserved with reserve().
+ *
+ * @tparam K the key type
+ * @tparam V the value type
+ * @tparam F the comparing function (default <)
+ * @tparam SplitValues true to keep the entries out of the nodes (default false)
+ */
+template <class K, class V, class F = ::default_less<K>, bool SplitValues = false>
+class CompactTree
+{
+    /** the pair with key and value */
+    using entry_type = std::pair<const K, V>;
+    /** the type of the copies of the keys */
+    using key_type = typename std::remove_const<K>::type;
+    /** an empty link */
+    static constexpr std::uint32_t nil = 0xffffffff;
+    /** the color bit of the successor index */
+    static constexpr std::uint32_t red_bit = 0x80000000;
+    /** the successor index of the last node, it is also the position of end() */
+    static constexpr std::uint32_t no_successor = 0x7fffffff;
+    /** more levels than a red-black tree with 2^31 nodes */
+    static constexpr std::size_t max_depth = 66;
+
+    /**
+     * @brief The three 32-bit links of a node
+     */
+    struct Links
+    {
+        /** left child */
+        std::uint32_t left = nil;
+        /** right child */
+        std::uint32_t right = nil;
+        /** the in-order successor between the ancestors, and the color in the highest bit (a new node is red) */
+        std::uint32_t successor_color;
+
+        explicit Links(std::uint32_t successor) : successor_color{successor | red_bit} {}
+        std::uint32_t successor() const noexcept {return successor_color & ~red_bit;}
+        void successor(std::uint32_t s) noexcept {successor_color = (successor_color & red_bit) | s;}
+        bool red() const noexcept {return successor_color & red_bit;}
+        void red(bool r) noexcept {successor_color = r ? (successor_color | red_bit) : (successor_color & ~red_bit);}
+    };
+    /**
+     * @brief A node with the entry inside
+     */
+    struct EntryNode : Links
+    {
+        /** pair with key and value */
+        entry_type entry;
+
+        EntryNode(const K& key, const V& value, std::uint32_t successor) : Links{successor}, entry{key, value} {}
+        const K& key() const noexcept {return entry.first;}
+    };
+    /**
+     * @brief A node with only the key, its entry is in the parallel vector
+     */
+    struct KeyNode : Links
+    {
+        /** copy of the key of the entry */
+        key_type key_copy;
+
+        KeyNode(const K& key, std::uint32_t successor) : Links{successor}, key_copy{key} {}
+        const K& key() const noexcept {return key_copy;}
+    };
+    /** the node of the chosen layout */
+    using Node = typename std::conditional<SplitValues, KeyNode, EntryNode>::type;
+
+    /** the nodes, in insertion order */
+    std::vector<Node> nodes;
+    /** the entries of the nodes in the same order, used only with SplitValues */
+    std::vector<entry_type> entries;
+    /** the position of the root */
+    std::uint32_t root = nil;
+    /** The comparison operator, a functional object that returns a boolean */
+    F cmp;
+
+    /**
+     * @brief The position of the node with a key, nil if it is not present
+     */
+    std::uint32_t search(const K& key) const;
+    /**
+     * @brief Three-way comparison of two keys, with a single call if the comparing function has a compare()
+     */
+    int compare(const K& k1, const K& k2) const
+    {
+        if constexpr (has_three_way<F,K>::value)
+            return cmp.compare(k1, k2);
+        else
+            return cmp(k1, k2) ? -1 : cmp(k2, k1) ? 1 : 0;
+    }
+    /**
+     * @brief The link that points to the i-th node of a path, the root or a child of the previous one
+     */
+    std::uint32_t& link_to(const std::uint32_t* path, std::size_t i) noexcept;
+    /** left rotation of the subtree owned by a link, as balancing::rotate_left() */
+    void rotate_left(std::uint32_t& link) noexcept;
+    /** right rotation of the subtree owned by a link, as balancing::rotate_right() */
+    void rotate_right(std::uint32_t& link) noexcept;
+    /**
+     * @brief Restores the red-black invariants after an insertion, as balancing::red_black::inserted()
+     * @param path the positions of the nodes from the root (path[0]) to the new one (path[length-1])
+     * @param length the number of nodes in the path
+     */
+    void fix_insertion(const std::uint32_t* path, std::size_t length) noexcept;
+    /**
+     * @brief A function to calculate the first node (following the key order)
+     * @return std::uint32_t the position of the first node, no_successor if the tree is empty
+     */
+    std::uint32_t first_node() const noexcept;
+    /**
+     * @brief The entry of the node in a position
+     */
+    entry_type& entry(std::uint32_t i) noexcept
+    {
+        if constexpr (SplitValues) return entries[i];
+        else return nodes[i].entry;
+    }
+    const entry_type& entry(std::uint32_t i) const noexcept
+    {
+        if constexpr (SplitValues) return entries[i];
+        else return nodes[i].entry;
+    }
+
+    public:
+
+    /**
+     * @brief Construct a new CompactTree object
+     */
+    CompactTree(F f = ::make_default_comparator<F,K>()): cmp{f} {};
+    CompactTree(const CompactTree&) = default;
+    /**
+     * @brief Copy assignment, the nodes cannot be assigned (their key is constant) so they are copied in a new vector
+     */
+    CompactTree& operator=(const CompactTree& other)
+    {
+        if(this != &other)
+            *this = CompactTree{other};
+        return *this;
+    }
+    /**
+     * @brief Move constructor, the other tree is left empty
+     */
+    CompactTree(CompactTree&& other) noexcept
+        : nodes{std::move(other.nodes)}, entries{std::move(other.entries)}, root{other.root}, cmp{other.cmp} {other.clear();}
+    /**
+     * @brief Move assignment, the other tree is left empty
+     */
+    CompactTree& operator=(CompactTree&& other) noexcept
+    {
+        nodes = std::move(other.nodes);
+        entries = std::move(other.entries);
+        root = other.root;
+        cmp = other.cmp;
+        other.clear();
+        return *this;
+    }
+
+    //clear the content of the tree
+    void clear() noexcept {nodes.clear(); entries.clear(); root = nil;}
+
+    /**
+     * @brief The number of elements in the tree
+     *
+     * @return std::size_t the number of nodes
+     */
+    std::size_t size() const noexcept {return nodes.size();}
+
+    /**
+     * @brief Reserves the space for a number of nodes, so that the entries do not move until the tree grows beyond it
+     *
+     * @param n the number of nodes
+     */
+    void reserve(std::size_t n)
+    {
+        nodes.reserve(n);
+        if constexpr (SplitValues) entries.reserve(n);
+    }
+
+    /**
+     * @brief Does nothing, a red-black tree is always balanced
+     * It is here so that a CompactTree can replace a BinaryTree.
+     */
+    void balance() noexcept {}
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * If the key is not present, a new pair with the given key and a default value will be inserted in the tree.
+    *
+    * @tparam const K& the key of the searched value
+    * @return V& reference to the value
+    */
+    V& operator[](const K& key);
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * @throws runtime_errors if the key is not present
+    * @tparam const K& the key of the searched value
+    * @return const V& reference to the value
+    */
+    const V& operator[](const K& key) const;
+
+    class Iterator;
+    class ConstIterator;
+
+    /**
+    * @brief a function that return an Iterator to the first element
+    * @return Iterator iterator to the first element
+    */
+    Iterator begin() {return Iterator{this, first_node()};}
+    /**
+    * @brief A function that return an Iterator to one past the last element
+    * @return Iterator iterator to the end
+    */
+    Iterator end() {return Iterator{this, no_successor};}
+    /**
+     * @brief A constant iterator version of begin()
+     * @return ConstIterator constant iterator to the first element
+     */
+    ConstIterator begin() const {return cbegin();}
+    /**
+     * @brief A constant interator version of end()
+     * @return ConstIterator returns a constant iterator to the end of the Data Structure
+     */
+    ConstIterator end() const {return cend();}
+    /**
+     * @brief Same as ConstIterator begin() but explicit
+     * @return ConstIterator constant iterator to the first element
+     */
+    ConstIterator cbegin() const {return ConstIterator{const_cast<CompactTree*>(this), first_node()};}
+    /**
+     * @brief Same as ConstIterator end() but explicit
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator cend() const {return ConstIterator{const_cast<CompactTree*>(this), no_successor};}
+
+    /**
+     * @brief Finds a value with a given key and returns an iterator to it
+     * @param key the key to be searched
+     * @return Iterator an Iterator to the entry with the key or to end() if its not present
+     */
+    Iterator find(const K& key);
+    /**
+     * @brief Constant version of find()
+     * @param key the key to be searched
+     * @return ConstIterator a ConstIterator to the entry with the key or to end() if its not present
+     */
+    ConstIterator find(const K& key) const;
+
+    /**
+     * @brief Insert a new entry with given key and value
+     * It returns a std::pair with an iterator to the entry and a bool, true if the key was not present.
+     * @throws std::length_error if the tree already has 2^31-1 nodes
+     * @param key the key of the new entry
+     * @param value the value of the new entry
+     * @return std::pair<Iterator,bool> a pair with an iterator to the inserted (or already present) entry and a bool that indicates if it has been added
+     */
+    std::pair<Iterator,bool> insert(const K& key, const V& value);
+    /**
+     * @brief An insert which takes directly an std::pair with the right types
+     *
+     * @param p the std::pair to be added
+     * @return std::pair<Iterator,bool> same as the other insert()
+     */
+    std::pair<Iterator,bool> insert(std::pair<const K&, const V&> p) {return insert(p.first,p.second);}
+
+    template <class k, class v, class f, bool s>
+    /**
+     * @brief Overloading of the operator<< for printing and writing on files
+     *
+     * @return std::ostream&
+     */
+    friend std::ostream& operator<<(std::ostream&, const CompactTree<k,v,f,s>&);
+};
+
+template <class K, class V, class F, bool S>
+class CompactTree<K,V,F,S>::Iterator
+{
+    /** the tree */
+    CompactTree* tree;
+    /** the position of the pointed node, no_successor at the end */
+    std::uint32_t index;
+
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    Iterator(CompactTree* t, std::uint32_t i) : tree{t}, index{i} {}
+    Iterator(const Iterator&) = default;
+    std::pair<const K, V>& operator*() const {return tree->entry(index);}
+
+    Iterator& operator++()
+    {
+        const Node& node = tree->nodes[index];
+        // when you can go right, go down to the smaller key on that branch
+        if(node.right != nil)
+        {
+            index = node.right;
+            while(tree->nodes[index].left != nil)
+                index = tree->nodes[index].left;
+        }
+        // else go to the successor between the ancestors
+        else
+            index = node.successor();
+        return *this;
+    }
+    Iterator operator++(int)
+    {
+        Iterator it{*this};
+        ++(*this);
+        return it;
+    }
+    bool operator==(const Iterator& other) const noexcept {return index == other.index;}
+    bool operator!=(const Iterator& other) const noexcept {return !(*this == other);}
+};
+
+template <class K, class V, class F, bool S>
+class CompactTree<K,V,F,S>::ConstIterator : public CompactTree<K,V,F,S>::Iterator
+{
+    public:
+        using non_const_it = CompactTree<K,V,F,S>::Iterator;
+        using non_const_it::Iterator;
+        const std::pair<const K, V>& operator*() const {return non_const_it::operator*();}
+};
+
+template <class K, class V, class F, bool S>
+std::uint32_t CompactTree<K,V,F,S>::search(const K& key) const
+{
+    std::uint32_t i = root;
+    while(i != nil)
+    {
+        const Node& node = nodes[i];
+        const int order = compare(key, node.key());
+        if(order < 0)
+            i = node.left;
+        else if(order > 0)
+            i = node.right;
+        else
+            break;
+    }
+    return i;
+}
+
+template <class K, class V, class F, bool S>
+std::uint32_t CompactTree<K,V,F,S>::first_node() const noexcept
+{
+    if(root == nil) return no_successor;
+    std::uint32_t i = root;
+    while(nodes[i].left != nil)
+        i = nodes[i].left;
+    return i;
+}
+
+template <class K, class V, class F, bool S>
+std::uint32_t& CompactTree<K,V,F,S>::link_to(const std::uint32_t* path, std::size_t i) noexcept
+{
+    if(i == 0) return root;
+    Node& parent = nodes[path[i-1]];
+    return parent.left == path[i] ? parent.left : parent.right;
+}
+
+template <class K, class V, class F, bool S>
+void CompactTree<K,V,F,S>::rotate_left(std::uint32_t& link) noexcept
+{
+    const std::uint32_t old_root = link;
+    const std::uint32_t new_root = nodes[old_root].right;
+    nodes[old_root].right = nodes[new_root].left;
+    nodes[new_root].left = old_root;
+    link = new_root;
+    // the old root is now the left child of the new one
+    nodes[old_root].successor(new_root);
+}
+
+template <class K, class V, class F, bool S>
+void CompactTree<K,V,F,S>::rotate_right(std::uint32_t& link) noexcept
+{
+    const std::uint32_t old_root = link;
+    const std::uint32_t new_root = nodes[old_root].left;
+    nodes[old_root].left = nodes[new_root].right;
+    nodes[new_root].right = old_root;
+    link = new_root;
+    // the new root takes the successor of the old one
+    nodes[new_root].successor(nodes[old_root].successor());
+}
+
+template <class K, class V, class F, bool S>
+void CompactTree<K,V,F,S>::fix_insertion(const std::uint32_t* path, std::size_t length) noexcept
+{
+    std::size_t i = length - 1;
+    // a red node with a red parent: the grandparent exists since the root is black
+    while(i >= 2 && nodes[path[i-1]].red())
+    {
+        const std::uint32_t parent = path[i-1];
+        const std::uint32_t grandparent = path[i-2];
+        const bool left_side = nodes[grandparent].left == parent;
+        const std::uint32_t uncle = left_side ? nodes[grandparent].right : nodes[grandparent].left;
+        if(uncle != nil && nodes[uncle].red())
+        {
+            // push the red color up and continue from the grandparent
+            nodes[uncle].red(false);
+            nodes[parent].red(false);
+            nodes[grandparent].red(true);
+            i -= 2;
+            continue;
+        }
+        // the new node is an inner grandchild: move it outside
+        const bool inner = left_side ? nodes[parent].right == path[i] : nodes[parent].left == path[i];
+        if(inner)
+            left_side ? rotate_left(nodes[grandparent].left) : rotate_right(nodes[grandparent].right);
+        std::uint32_t& link = link_to(path, i-2);
+        left_side ? rotate_right(link) : rotate_left(link);
+        nodes[link].red(false);
+        nodes[left_side ? nodes[link].right : nodes[link].left].red(true);
+        break;
+    }
+    nodes[root].red(false);
+}
+
+template <class K, class V, class F, bool S>
+typename CompactTree<K,V,F,S>::Iterator CompactTree<K,V,F,S>::find(const K& key)
+{
+    const std::uint32_t i = search(key);
+    return i == nil ? end() : Iterator{this, i};
+}
+
+template <class K, class V, class F, bool S>
+typename CompactTree<K,V,F,S>::ConstIterator CompactTree<K,V,F,S>::find(const K& key) const
+{
+    const std::uint32_t i = search(key);
+    return i == nil ? cend() : ConstIterator{const_cast<CompactTree*>(this), i};
+}
+
+template <class K, class V, class F, bool S>
+std::pair<typename CompactTree<K,V,F,S>::Iterator,bool> CompactTree<K,V,F,S>::insert(const K& key, const V& value)
+{
+    std::uint32_t path[max_depth];
+    std::size_t length = 0;
+    std::uint32_t successor = no_successor;
+    std::uint32_t i = root;
+    bool left = false;
+    while(i != nil)
+    {
+        path[length++] = i;
+        const Node& node = nodes[i];
+        const int order = compare(key, node.key());
+        left = order < 0;
+        if(left)
+        {
+            // going left, the node is the successor of the new one
+            successor = i;
+            i = node.left;
+        }
+        else if(order > 0)
+            i = node.right;
+        else
+            return std::pair<Iterator,bool>{Iterator{this, i}, false};
+    }
+    if(nodes.size() >= no_successor)
+        throw std::length_error("A CompactTree can hold at most 2^31-1 nodes");
+    const std::uint32_t added = std::uint32_t(nodes.size());
+    // the vector can move the nodes, so the links are reached only after the growth
+    if constexpr (S)
+    {
+        entries.emplace_back(key, value);
+        try
+        {
+            nodes.emplace_back(key, successor);
+        }
+        catch(...)
+        {
+            entries.pop_back();
+            throw;
+        }
+    }
+    else
+        nodes.emplace_back(key, value, successor);
+    if(length == 0)
+        root = added;
+    else if(left)
+        nodes[path[length-1]].left = added;
+    else
+        nodes[path[length-1]].right = added;
+    path[length++] = added;
+    fix_insertion(path, length);
+    return std::pair<Iterator,bool>{Iterator{this, added}, true};
+}
+
+template <class K, class V, class F, bool S>
+V& CompactTree<K,V,F,S>::operator[](const K& key)
+{
+    Iterator s_res = find(key);
+    if(s_res != end()) return (*s_res).second;
+    return (*insert(key, V{}).first).second;
+}
+
+template <class K, class V, class F, bool S>
+const V& CompactTree<K,V,F,S>::operator[](const K& key) const
+{
+    const std::uint32_t i = search(key);
+    if(i != nil) return entry(i).second;
+    //is a constant method, if it does not find the key it throws an exception
+    throw std::runtime_error("You are trying to acces a non existing key");
+}
+
+template <class k, class v, class f, bool s>
+std::ostream& operator<<(std::ostream& os, const CompactTree<k,v,f,s>& ct)
+{
+    for(const auto& vals : ct)
+        os << "(" << vals.first << ":" << vals.second << ") ";
+    os << std::endl;
+    return os;
+}
+
+#endif
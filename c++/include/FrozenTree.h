@@ -0,0 +1,372 @@
+/**
+ * @file FrozenTree.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Read-only snapshot of a BinaryTree in Eytzinger layout
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __FROZENTREE__
+#define __FROZENTREE__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include "BinaryTreeRec.h"
+
+namespace layout
+{
+/**
+ * @brief Asks the processor to start loading a memory address in cache
+ *
+ * The address is computed as an integer, so it can be past the end of an array:
+ * a prefetch never faults.
+ *
+ * @param base the start of the array
+ * @param offset the offset in bytes
+ */
+inline void prefetch(const void* base, std::size_t offset) noexcept
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(base) + offset));
+#else
+    (void)base;
+    (void)offset;
+#endif
+}
+
+/**
+ * @brief Undoes the last right turns of a descent in an implicit tree
+ *
+ * A branchless descent ends below the leaves, after the last node that was not less than the key it
+ * turned right as many times as the trailing ones of the index: removing them and one more bit gives that node.
+ *
+ * @param k the index where the descent stopped
+ * @return std::size_t the index of the lower bound, 0 if all the keys are less than the searched one
+ */
+inline std::size_t lower_bound_index(std::size_t k) noexcept
+{
+#if defined(__GNUC__)
+    return k >> __builtin_ffsll((long long)(~k));
+#else
+    while(k & 1) k >>= 1;
+    return k >> 1;
+#endif
+}
+}
+
+/**
+ * @brief A read-only tree whose keys are stored in breadth-first (Eytzinger) order
+ *
+ * The node k of the implicit tree has its children in positions 2k and 2k+1 of a single array, so a lookup
+ * walks through one contiguous block of memory without following any pointer. The search loop has no
+ * unpredictable branches (the comparison result is added to the index) and, at every step, prefetches the
+ * keys four levels below, which for small keys are in the same cache line.
+ * The keys are kept in their own array, the entries in a parallel one, so only the keys are read while descending.
+ *
+ * It is built from any sorted sequence of entries, usually with BinaryTree::freeze().
+ *
+ * @tparam K the key type
+ * @tparam V the value type
+ * @tparam F the comparing function (default <)
+ */
+template <class K, class V, class F = ::default_less<K>>
+class FrozenTree
+{
+    /** the pair with key and value */
+    using entry_type = std::pair<const K, V>;
+    /** the type of the copies of the keys */
+    using key_type = typename std::remove_const<K>::type;
+
+    /** the keys in Eytzinger order, the root is keys[1] (keys[0] is not used) */
+    std::vector<key_type> keys;
+    /** the entries in the same order, the entry of keys[k] is entries[k-1] */
+    std::vector<entry_type> entries;
+    /** The comparison operator, a functional object that returns a boolean */
+    F cmp;
+
+    /**
+     * @brief Recursively assigns the sorted positions to the nodes of the implicit tree
+     *
+     * @param order the sorted position of every node
+     * @param k the node
+     * @param next the next sorted position to assign
+     */
+    static void eytzinger(std::vector<std::size_t>& order, std::size_t k, std::size_t& next) noexcept;
+    /**
+     * @brief The branchless search of the first key not less than the given one
+     * @param key the key to be searched
+     * @return std::size_t its index in the implicit tree, 0 if there is none
+     */
+    std::size_t lower_bound(const K& key) const;
+
+    public:
+    class ConstIterator;
+    /** a frozen tree cannot be modified, so all its iterators are constant */
+    using Iterator = ConstIterator;
+
+    /**
+     * @brief Construct an empty FrozenTree
+     */
+    FrozenTree(F f = ::make_default_comparator<F,K>()): cmp{f} {}
+    /**
+     * @brief Construct a FrozenTree from a sorted sequence of entries
+     *
+     * @param first iterator to the first entry
+     * @param last iterator past the last entry
+     * @param f the comparing function, the sequence must be sorted according to it and have no duplicated keys
+     */
+    template <class It>
+    FrozenTree(It first, It last, F f = ::make_default_comparator<F,K>());
+
+    /**
+     * @brief The number of elements in the tree
+     *
+     * @return std::size_t the number of entries
+     */
+    std::size_t size() const noexcept {return entries.size();}
+
+    /**
+     * @brief Finds a value with a given key and returns an iterator to it
+     * @param key the key to be searched
+     * @return ConstIterator iterator to the entry with the key or to end() if its not present
+     */
+    ConstIterator find(const K& key) const;
+
+    /**
+     * @brief Finds many keys at once, faster than calling find() for each of them on a tree larger than the cache
+     *
+     * The keys are searched in groups of batch_width: the descents of a group go down one level together,
+     * so the cache misses of the different searches overlap instead of following one another.
+     * @param keys_in a range of keys, e.g. a std::vector<K>
+     * @param results_out an output iterator, a ConstIterator is written for every key in the same order (end() if it is not present)
+     * @return Out the output iterator past the last result
+     */
+    template <class KeyRange, class Out>
+    Out find_batch(const KeyRange& keys_in, Out results_out) const;
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * @throws runtime_errors if the key is not present, since the tree cannot be modified
+    * @tparam const K& the key of the searched value
+    * @return const V& reference to the value
+    */
+    const V& operator[](const K& key) const;
+
+    /**
+     * @brief Iterator to the smallest key
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator begin() const;
+    /**
+     * @brief Iterator past the last entry
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator end() const {return ConstIterator{this, 0};}
+    /**
+     * @brief Same as begin()
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator cbegin() const {return begin();}
+    /**
+     * @brief Same as end()
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator cend() const {return end();}
+
+    template <class k, class v, class f>
+    /**
+     * @brief Overloading of the operator<< for printing and writing on files
+     *
+     * @return std::ostream&
+     */
+    friend std::ostream& operator<<(std::ostream&, const FrozenTree<k,v,f>&);
+};
+
+/**
+ * @brief In-order iterator over a FrozenTree
+ *
+ * The successor of a node is found with the index arithmetic of the implicit tree.
+ */
+template <class K, class V, class F>
+class FrozenTree<K,V,F>::ConstIterator
+{
+    /** the tree */
+    const FrozenTree* tree;
+    /** the index of the node in the implicit tree, 0 at the end */
+    std::size_t k;
+
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    ConstIterator(const FrozenTree* t, std::size_t index) : tree{t}, k{index} {}
+    const std::pair<const K, V>& operator*() const {return tree->entries[k - 1];}
+
+    ConstIterator& operator++()
+    {
+        const std::size_t n = tree->entries.size();
+        // when you can go right, go down to the smaller key on that branch
+        if(2*k + 1 <= n)
+        {
+            k = 2*k + 1;
+            while(2*k <= n)
+                k = 2*k;
+        }
+        // else go up to the first ancestor of which we are in the left branch
+        else
+            k = layout::lower_bound_index(k);
+        return *this;
+    }
+    ConstIterator operator++(int)
+    {
+        ConstIterator it{*this};
+        ++(*this);
+        return it;
+    }
+    bool operator==(const ConstIterator& other) const noexcept {return k == other.k;}
+    bool operator!=(const ConstIterator& other) const noexcept {return !(*this == other);}
+};
+
+template <class K, class V, class F>
+template <class It>
+FrozenTree<K,V,F>::FrozenTree(It first, It last, F f) : cmp{f}
+{
+    std::vector<entry_type> sorted(first, last);
+    const std::size_t n = sorted.size();
+    if(n == 0) return;
+    std::vector<std::size_t> order(n + 1);
+    std::size_t next = 0;
+    eytzinger(order, 1, next);
+    keys.reserve(n + 1);
+    entries.reserve(n);
+    // the position 0 is never read, it just holds a valid key
+    keys.push_back(sorted[0].first);
+    for(std::size_t k = 1; k <= n; ++k)
+    {
+        keys.push_back(sorted[order[k]].first);
+        entries.emplace_back(std::move(sorted[order[k]]));
+    }
+}
+
+template <class K, class V, class F>
+void FrozenTree<K,V,F>::eytzinger(std::vector<std::size_t>& order, std::size_t k, std::size_t& next) noexcept
+{
+    // an in-order visit of the implicit tree meets the sorted entries one after the other
+    if(k >= order.size()) return;
+    eytzinger(order, 2*k, next);
+    order[k] = next++;
+    eytzinger(order, 2*k + 1, next);
+}
+
+template <class K, class V, class F>
+std::size_t FrozenTree<K,V,F>::lower_bound(const K& key) const
+{
+    const std::size_t n = entries.size();
+    const key_type* base = keys.data();
+    std::size_t k = 1;
+    while(k <= n)
+    {
+        // the 16 descendants four levels below are contiguous
+        layout::prefetch(base, 16*k*sizeof(key_type));
+        k = 2*k + std::size_t(cmp(base[k], key));
+    }
+    return layout::lower_bound_index(k);
+}
+
+template <class K, class V, class F>
+typename FrozenTree<K,V,F>::ConstIterator FrozenTree<K,V,F>::find(const K& key) const
+{
+    std::size_t k = lower_bound(key);
+    if(k != 0 && !cmp(key, keys[k]))
+        return ConstIterator{this, k};
+    return end();
+}
+
+template <class K, class V, class F>
+template <class KeyRange, class Out>
+Out FrozenTree<K,V,F>::find_batch(const KeyRange& keys_in, Out results_out) const
+{
+    const std::size_t n = entries.size();
+    const key_type* base = keys.data();
+    auto key = std::begin(keys_in);
+    const auto last = std::end(keys_in);
+    decltype(key) group[batch_width];
+    std::size_t k[batch_width];
+    while(key != last)
+    {
+        std::size_t count = 0;
+        for(; count < batch_width && key != last; ++count, ++key)
+        {
+            group[count] = key;
+            k[count] = 1;
+        }
+        // the tree is complete: the descents of the group end at the same level, or one level apart
+        for(bool active = true; active; )
+        {
+            active = false;
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                if(k[i] > n) continue;
+                layout::prefetch(base, 16*k[i]*sizeof(key_type));
+                k[i] = 2*k[i] + std::size_t(cmp(base[k[i]], *group[i]));
+                active = true;
+            }
+        }
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            const std::size_t found = layout::lower_bound_index(k[i]);
+            *results_out++ = found != 0 && !cmp(*group[i], keys[found]) ? ConstIterator{this, found} : end();
+        }
+    }
+    return results_out;
+}
+
+template <class K, class V, class F>
+const V& FrozenTree<K,V,F>::operator[](const K& key) const
+{
+    std::size_t k = lower_bound(key);
+    if(k != 0 && !cmp(key, keys[k]))
+        return entries[k - 1].second;
+    throw std::runtime_error("You are trying to acces a non existing key");
+}
+
+template <class K, class V, class F>
+typename FrozenTree<K,V,F>::ConstIterator FrozenTree<K,V,F>::begin() const
+{
+    if(entries.empty()) return end();
+    // the leftmost node
+    std::size_t k = 1;
+    while(2*k <= entries.size())
+        k = 2*k;
+    return ConstIterator{this, k};
+}
+
+template <class K, class V, class F, class B, class A>
+FrozenTree<K,V,F> BinaryTree<K,V,F,B,A>::freeze() const
+{
+    return FrozenTree<K,V,F>(begin(), end(), cmp);
+}
+
+template <class k, class v, class f>
+std::ostream& operator<<(std::ostream& os, const FrozenTree<k,v,f>& ft)
+{
+    for(const auto& vals : ft)
+        os << "(" << vals.first << ":" << vals.second << ") ";
+    os << std::endl;
+    return os;
+}
+
+#endif
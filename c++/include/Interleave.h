@@ -0,0 +1,312 @@
+/**
+ * @file Interleave.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Lookups written as C++20 coroutines, interleaved by a round-robin scheduler to hide the memory latency
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __INTERLEAVE__
+#define __INTERLEAVE__
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include "BinaryTreeRec.h"
+
+namespace interleave
+{
+/**
+ * @brief The coroutine frames freed on this thread, kept for the next coroutines of the same size class
+ *
+ * A lookup coroutine lives for a few hundred nanoseconds, so it would pay a malloc and a free for every key.
+ * The frames are rounded up to a multiple of 64 bytes and a freed one goes in the list of its class, up to
+ * a limit; the larger frames go straight to operator new and delete.
+ */
+class frame_cache
+{
+    /** the granularity of the size classes */
+    static constexpr std::size_t granularity = 64;
+    /** the number of size classes, frames up to 1KB are kept */
+    static constexpr std::size_t classes = 16;
+    /** the maximum number of frames kept in a class */
+    static constexpr std::size_t limit = 256;
+
+    /** a free frame, linked to the next one */
+    struct free_frame { free_frame* next; };
+    /** the lists of the free frames of a thread, given back when the thread ends */
+    struct lists
+    {
+        free_frame* head[classes] = {};
+        std::size_t count[classes] = {};
+        ~lists()
+        {
+            for(auto first : head)
+                while(first != nullptr)
+                    ::operator delete(std::exchange(first, first->next));
+        }
+    };
+    /** the lists of this thread */
+    static lists& local() noexcept
+    {
+        thread_local lists frames;
+        return frames;
+    }
+    /** the size class of a frame, classes if it is too large to be kept */
+    static std::size_t size_class(std::size_t bytes) noexcept
+    {
+        const std::size_t c = (bytes + granularity - 1)/granularity;
+        return c > 0 && c <= classes ? c - 1 : classes;
+    }
+
+    public:
+    /**
+     * @brief A frame from the list of its size class, or a new one if the list is empty
+     * @param bytes the size of the frame
+     * @return void* the frame
+     */
+    static void* allocate(std::size_t bytes)
+    {
+        const std::size_t c = size_class(bytes);
+        if(c == classes)
+            return ::operator new(bytes);
+        lists& frames = local();
+        if(frames.head[c] == nullptr)
+            return ::operator new((c + 1)*granularity);
+        --frames.count[c];
+        return std::exchange(frames.head[c], frames.head[c]->next);
+    }
+    /**
+     * @brief Puts a frame in the list of its size class if there is room, otherwise frees it
+     * @param frame the frame
+     * @param bytes the size asked for it
+     */
+    static void deallocate(void* frame, std::size_t bytes) noexcept
+    {
+        const std::size_t c = size_class(bytes);
+        lists& frames = local();
+        if(c == classes || frames.count[c] == limit)
+        {
+            ::operator delete(frame);
+            return;
+        }
+        ++frames.count[c];
+        frames.head[c] = ::new (frame) free_frame{frames.head[c]};
+    }
+};
+
+/**
+ * @brief A coroutine run by a scheduler: it starts suspended and it is resumed until it is done
+ *
+ * Any function returning a task and using co_await is one, e.g. BinaryTree::co_find() or some work of the
+ * caller that has to be mixed with the lookups. The task owns the coroutine and destroys it.
+ * An exception that escapes the coroutine is kept, and thrown again by rethrow().
+ */
+class task
+{
+    public:
+    struct promise_type
+    {
+        /** the exception that ended the coroutine, if any */
+        std::exception_ptr error;
+
+        task get_return_object() noexcept {return task{std::coroutine_handle<promise_type>::from_promise(*this)};}
+        std::suspend_always initial_suspend() const noexcept {return {};}
+        std::suspend_always final_suspend() const noexcept {return {};}
+        void return_void() const noexcept {}
+        void unhandled_exception() noexcept {error = std::current_exception();}
+        static void* operator new(std::size_t bytes) {return frame_cache::allocate(bytes);}
+        static void operator delete(void* frame, std::size_t bytes) noexcept {frame_cache::deallocate(frame, bytes);}
+    };
+
+    private:
+    /** the coroutine, null for an empty task */
+    std::coroutine_handle<promise_type> coroutine;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : coroutine{handle} {}
+
+    public:
+    /**
+     * @brief Construct an empty task, already done
+     */
+    task() noexcept = default;
+    task(task&& other) noexcept : coroutine{std::exchange(other.coroutine, nullptr)} {}
+    task& operator=(task&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(coroutine) coroutine.destroy();
+            coroutine = std::exchange(other.coroutine, nullptr);
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    /**
+     * @brief Destroys the coroutine, also if it is not done
+     */
+    ~task() {if(coroutine) coroutine.destroy();}
+
+    /**
+     * @brief Tells if the coroutine has finished, an empty task is always done
+     * @return true if there is nothing left to run
+     */
+    bool done() const noexcept {return !coroutine || coroutine.done();}
+    /**
+     * @brief Runs the coroutine until its next suspension or its end, it must not be done
+     */
+    void resume() const {coroutine.resume();}
+    /**
+     * @brief Throws the exception that ended the coroutine, if any
+     */
+    void rethrow() const
+    {
+        if(coroutine && coroutine.promise().error)
+            std::rethrow_exception(coroutine.promise().error);
+    }
+};
+
+/**
+ * @brief Asks the processor to load an address and suspends the coroutine, so others run while it arrives
+ *
+ * `co_await interleave::prefetch{next}` is the step of a lookup: the load of the next node is started, then
+ * the scheduler resumes the other coroutines before this one reads it. A null address does not suspend.
+ */
+struct prefetch
+{
+    /** the address to load */
+    const void* address;
+
+    bool await_ready() const noexcept
+    {
+        if(address == nullptr) return true;
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#endif
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
+};
+
+/**
+ * @brief Runs a number of tasks together, resuming them in round-robin
+ *
+ * At most width() tasks run at the same time: spawn() adds a task, and when they are already width() it first
+ * runs the others until one of them is done. Every task runs until its next suspension, then the next one
+ * is resumed, so a task that suspends after a prefetch finds its data in cache when its turn comes again
+ * and the memory latencies of the different tasks overlap. run() finishes all the tasks.
+ *
+ * The tasks can be lookups of different trees or any other work of the caller: a coroutine suspends
+ * with `co_await interleave::prefetch{address}`, or with `co_await std::suspend_always{}` just to let the others run.
+ * An exception thrown by a task is thrown again by the spawn() or run() that finishes it.
+ */
+class scheduler
+{
+    /** the running tasks */
+    std::vector<task> running;
+    /** the maximum number of running tasks */
+    std::size_t lanes;
+    /** the task that is resumed next */
+    std::size_t next = 0;
+
+    /**
+     * @brief Resumes the next task, and removes it if it is done
+     */
+    void step()
+    {
+        running[next].resume();
+        if(running[next].done())
+        {
+            // the last task takes the place of the finished one, and it is resumed next
+            task finished = std::move(running[next]);
+            if(next + 1 != running.size())
+                running[next] = std::move(running.back());
+            running.pop_back();
+            if(next == running.size()) next = 0;
+            finished.rethrow();
+        }
+        else if(++next == running.size())
+            next = 0;
+    }
+
+    public:
+    /**
+     * @brief Construct a new scheduler
+     *
+     * @param width the maximum number of tasks that run together, about the number of memory accesses
+     * the processor can have in flight
+     */
+    explicit scheduler(std::size_t width = batch_width) : lanes{width > 0 ? width : 1} {running.reserve(lanes);}
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    /**
+     * @brief Adds a task, after running the others until there is room for it
+     * @param work the task, not started yet
+     */
+    void spawn(task work)
+    {
+        while(running.size() == lanes)
+            step();
+        if(!work.done())
+            running.push_back(std::move(work));
+    }
+    /**
+     * @brief Runs all the tasks until they are done
+     */
+    void run()
+    {
+        while(!running.empty())
+            step();
+    }
+
+    /**
+     * @brief The number of tasks not done yet
+     * @return std::size_t the running tasks
+     */
+    std::size_t size() const noexcept {return running.size();}
+    /**
+     * @brief The maximum number of tasks that run together
+     * @return std::size_t the width given to the constructor
+     */
+    std::size_t width() const noexcept {return lanes;}
+};
+}
+
+template <class K, class V, class F, class B, class A>
+template <class It, class Out>
+interleave::task BinaryTree<K,V,F,B,A>::co_lookup(K key, Out result) const
+{
+    Node* node = root.get();
+    while(node != nullptr)
+    {
+        const int order = compare(key, node->entry.first);
+        if(order == 0) break;
+        node = order < 0 ? node->_left.get() : node->_right.get();
+        // the next node is loaded while the scheduler runs the other coroutines
+        co_await interleave::prefetch{node};
+    }
+    *result = It{node};
+}
+
+template <class K, class V, class F, class B, class A>
+template <class Out>
+interleave::task BinaryTree<K,V,F,B,A>::co_find(K key, Out result)
+{
+    return co_lookup<Iterator>(std::move(key), result);
+}
+
+template <class K, class V, class F, class B, class A>
+template <class Out>
+interleave::task BinaryTree<K,V,F,B,A>::co_find(K key, Out result) const
+{
+    return co_lookup<ConstIterator>(std::move(key), result);
+}
+
+#endif
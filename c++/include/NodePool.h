@@ -0,0 +1,299 @@
+/**
+ * @file NodePool.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Memory resources that carve the nodes of a tree from large blocks, optionally on huge pages
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __NODEPOOL__
+#define __NODEPOOL__
+
+#include <memory_resource>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <cstdint>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define __NODEPOOL_MMAP__
+#endif
+
+/**
+ * @brief A slab memory resource for the nodes of a tree, to be used with pmr::BinaryTree
+ *
+ * All the nodes of a tree have the same size, fixed by the first allocation. The pool takes them one after
+ * the other from a large block (bump allocation) and asks the upstream resource for a new block, twice as large
+ * as the previous one up to a limit, only when the block is full. A freed node goes in a free list and is
+ * reused by the next allocation. The allocations of a different size or alignment are forwarded upstream.
+ *
+ * The blocks are given back all at once by release() or by the destructor: a pool can hold the nodes of
+ * many trees, and when they are not needed any more the memory is returned in one go.
+ * With a huge_page_resource upstream the blocks are put on huge pages.
+ * The pool is not thread-safe.
+ */
+class node_pool : public std::pmr::memory_resource
+{
+    /** a free slot, linked to the next one */
+    struct free_slot { free_slot* next; };
+
+    /** where the blocks come from */
+    std::pmr::memory_resource* upstream;
+    /** the size of a slot, 0 until the first allocation */
+    std::size_t slot_bytes = 0;
+    /** the alignment of the slots */
+    std::size_t slot_align = 0;
+    /** the number of slots of the next block */
+    std::size_t next_slots;
+    /** the maximum number of slots in a block */
+    std::size_t max_slots;
+    /** the blocks taken from upstream, with their size in bytes */
+    std::vector<std::pair<void*, std::size_t>> blocks;
+    /** the list of the freed slots */
+    free_slot* free_list = nullptr;
+    /** the next slot never used of the last block */
+    char* cursor = nullptr;
+    /** the end of the last block */
+    char* block_end = nullptr;
+    /** the number of slots in use */
+    std::size_t used = 0;
+
+    /** true if an allocation goes in the slots */
+    bool in_slots(std::size_t bytes, std::size_t alignment) const noexcept
+    {
+        return bytes == slot_bytes && alignment == slot_align;
+    }
+
+    /**
+     * @brief Takes a new block from upstream
+     */
+    void grow()
+    {
+        const std::size_t size = next_slots*slot_bytes;
+        // the room for the block is made first, so that it is not lost if the vector cannot grow;
+        // the capacity doubles, so the list is not copied at every block
+        if(blocks.size() == blocks.capacity())
+            blocks.reserve(2*blocks.size() + 1);
+        cursor = static_cast<char*>(upstream->allocate(size, slot_align));
+        block_end = cursor + size;
+        blocks.emplace_back(cursor, size);
+        next_slots = std::min(2*next_slots, max_slots);
+    }
+
+    protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        // the first allocation fixes the size of the slots, if a freed one can hold the link of the free list
+        if(slot_bytes == 0 && bytes >= sizeof(free_slot) && alignment >= alignof(free_slot))
+        {
+            slot_bytes = bytes;
+            slot_align = alignment;
+        }
+        if(!in_slots(bytes, alignment))
+            return upstream->allocate(bytes, alignment);
+        ++used;
+        if(free_list != nullptr)
+        {
+            free_slot* slot = free_list;
+            free_list = slot->next;
+            return slot;
+        }
+        if(cursor == block_end)
+        {
+            try
+            {
+                grow();
+            }
+            catch(...)
+            {
+                --used;
+                throw;
+            }
+        }
+        void* slot = cursor;
+        cursor += slot_bytes;
+        return slot;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        if(!in_slots(bytes, alignment))
+        {
+            upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        --used;
+        free_list = ::new (p) free_slot{free_list};
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    public:
+    /**
+     * @brief Construct a new node pool
+     *
+     * @param first_slots the number of slots of the first block
+     * @param largest_slots the maximum number of slots of a block
+     * @param source the resource from which the blocks are taken
+     */
+    explicit node_pool(std::size_t first_slots = 256, std::size_t largest_slots = std::size_t(1) << 16,
+                       std::pmr::memory_resource* source = std::pmr::get_default_resource())
+        : upstream{source}, next_slots{std::max<std::size_t>(first_slots, 1)}, max_slots{std::max(largest_slots, first_slots)} {}
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+    /**
+     * @brief Gives all the blocks back to the upstream resource
+     */
+    ~node_pool() override {release();}
+
+    /**
+     * @brief Gives all the blocks back to the upstream resource, even if some nodes are still in use
+     *
+     * The trees allocated from the pool must not be used any more, not even destroyed, after this call.
+     */
+    void release() noexcept
+    {
+        for(auto& block : blocks)
+            upstream->deallocate(block.first, block.second, slot_align);
+        blocks.clear();
+        free_list = nullptr;
+        cursor = block_end = nullptr;
+        used = 0;
+    }
+
+    /**
+     * @brief The number of blocks taken from the upstream resource
+     *
+     * @return std::size_t the number of blocks
+     */
+    std::size_t block_count() const noexcept {return blocks.size();}
+    /**
+     * @brief The size of the slots, 0 before the first allocation
+     *
+     * @return std::size_t the bytes of a slot
+     */
+    std::size_t slot_size() const noexcept {return slot_bytes;}
+    /**
+     * @brief The number of slots in use
+     *
+     * @return std::size_t the number of allocated nodes
+     */
+    std::size_t slots_in_use() const noexcept {return used;}
+    /**
+     * @brief The bytes taken from the upstream resource for the blocks
+     *
+     * @return std::size_t the total size of the blocks
+     */
+    std::size_t reserved_bytes() const noexcept
+    {
+        std::size_t total = 0;
+        for(const auto& block : blocks)
+            total += block.second;
+        return total;
+    }
+};
+
+/**
+ * @brief A memory resource that maps its blocks on huge pages, to be used as the upstream of a node_pool
+ *
+ * The nodes of a large tree are scattered over many pages, and a random lookup misses the TLB at almost
+ * every level. With pages of 2MB instead of 4KB the same TLB entries cover 512 times more nodes.
+ * Every block is first asked with MAP_HUGETLB, which needs huge pages reserved by the system; if there are
+ * none it is mapped aligned to the huge page size and marked with madvise(MADV_HUGEPAGE), so that the kernel
+ * backs it with transparent huge pages when it can. Where mmap is not available it falls back to operator new.
+ *
+ * The sizes are rounded up to the huge page size, so the blocks of the pool should be large: a few MB or more.
+ */
+class huge_page_resource : public std::pmr::memory_resource
+{
+    /** the size of a huge page */
+    std::size_t page_bytes;
+    /** the number of blocks mapped with MAP_HUGETLB */
+    std::size_t hugetlb_blocks = 0;
+
+    /** the size of a block, rounded up to the huge pages */
+    std::size_t rounded(std::size_t bytes) const noexcept {return (bytes + page_bytes - 1)/page_bytes*page_bytes;}
+
+    protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        const std::size_t size = rounded(bytes);
+#ifdef __NODEPOOL_MMAP__
+        if(alignment > page_bytes)
+            throw std::bad_alloc{};
+#ifdef MAP_HUGETLB
+        void* huge = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(huge != MAP_FAILED)
+        {
+            ++hugetlb_blocks;
+            return huge;
+        }
+#endif
+        // one more huge page, to cut the mapping at a huge page boundary
+        void* mapped = ::mmap(nullptr, size + page_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED)
+            throw std::bad_alloc{};
+        char* first = static_cast<char*>(mapped);
+        char* last = first + size + page_bytes;
+        char* aligned = first + (page_bytes - std::uintptr_t(first) % page_bytes) % page_bytes;
+        if(aligned != first)
+            ::munmap(first, std::size_t(aligned - first));
+        if(aligned + size != last)
+            ::munmap(aligned + size, std::size_t(last - (aligned + size)));
+#ifdef MADV_HUGEPAGE
+        ::madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+        return aligned;
+#else
+        return ::operator new(size, std::align_val_t{std::max(alignment, page_bytes)});
+#endif
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+#ifdef __NODEPOOL_MMAP__
+        (void)alignment;
+        ::munmap(p, rounded(bytes));
+#else
+        ::operator delete(p, rounded(bytes), std::align_val_t{std::max(alignment, page_bytes)});
+#endif
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    public:
+    /**
+     * @brief Construct a new huge page resource
+     *
+     * @param huge_page the size of a huge page, 2MB on x86-64
+     */
+    explicit huge_page_resource(std::size_t huge_page = std::size_t(1) << 21) : page_bytes{huge_page} {}
+    huge_page_resource(const huge_page_resource&) = delete;
+    huge_page_resource& operator=(const huge_page_resource&) = delete;
+
+    /**
+     * @brief The size of the huge pages
+     *
+     * @return std::size_t the bytes of a huge page
+     */
+    std::size_t huge_page_size() const noexcept {return page_bytes;}
+    /**
+     * @brief The number of blocks that got reserved huge pages (MAP_HUGETLB), the other ones were only advised
+     *
+     * @return std::size_t the number of blocks
+     */
+    std::size_t reserved_huge_blocks() const noexcept {return hugetlb_blocks;}
+};
+
+#endif
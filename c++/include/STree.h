@@ -0,0 +1,429 @@
+/**
+ * @file STree.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Read-only k-ary search index compared with vector instructions
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __STREE__
+#define __STREE__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <cstddef>
+#include "BinaryTreeRec.h"
+#include "FrozenTree.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace simd
+{
+/**
+ * @brief Counts the keys of a sorted block that are less than a given one
+ *
+ * Since the block is sorted, the count is also the position of the first key not less than x.
+ * This generic version is a simple loop without branches, that the compiler can vectorize by itself;
+ * the specializations below use the SSE2 or AVX2 instructions for int, float and double keys.
+ *
+ * @tparam T the key type
+ * @tparam B the number of keys in the block
+ * @param keys the block, aligned to a cache line
+ * @param x the searched key
+ * @return unsigned the number of keys less than x
+ */
+template <class T, std::size_t B>
+inline unsigned count_less(const T* keys, T x) noexcept
+{
+    unsigned count = 0;
+    for(std::size_t i = 0; i < B; ++i)
+        count += keys[i] < x;
+    return count;
+}
+
+#if defined(__SSE2__)
+/** the number of bits set in a mask */
+inline unsigned popcount(unsigned mask) noexcept {return unsigned(__builtin_popcount(mask));}
+
+template <>
+inline unsigned count_less<int, 16>(const int* keys, int x) noexcept
+{
+#if defined(__AVX2__)
+    const __m256i xv = _mm256_set1_epi32(x);
+    const __m256i lo = _mm256_cmpgt_epi32(xv, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys)));
+    const __m256i hi = _mm256_cmpgt_epi32(xv, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + 8)));
+    return popcount(unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(lo))) | unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(hi))) << 8);
+#else
+    const __m128i xv = _mm_set1_epi32(x);
+    const __m128i c0 = _mm_cmpgt_epi32(xv, _mm_load_si128(reinterpret_cast<const __m128i*>(keys)));
+    const __m128i c1 = _mm_cmpgt_epi32(xv, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 4)));
+    const __m128i c2 = _mm_cmpgt_epi32(xv, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 8)));
+    const __m128i c3 = _mm_cmpgt_epi32(xv, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 12)));
+    // the 16 results are packed in 16 bytes, one bit each for the mask
+    return popcount(unsigned(_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3)))));
+#endif
+}
+
+template <>
+inline unsigned count_less<float, 16>(const float* keys, float x) noexcept
+{
+#if defined(__AVX2__)
+    const __m256 xv = _mm256_set1_ps(x);
+    const unsigned lo = unsigned(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(keys), xv, _CMP_LT_OQ)));
+    const unsigned hi = unsigned(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(keys + 8), xv, _CMP_LT_OQ)));
+    return popcount(lo | hi << 8);
+#else
+    const __m128 xv = _mm_set1_ps(x);
+    unsigned mask = 0;
+    for(std::size_t i = 0; i < 4; ++i)
+        mask |= unsigned(_mm_movemask_ps(_mm_cmplt_ps(_mm_load_ps(keys + 4*i), xv))) << 4*i;
+    return popcount(mask);
+#endif
+}
+
+template <>
+inline unsigned count_less<double, 8>(const double* keys, double x) noexcept
+{
+#if defined(__AVX2__)
+    const __m256d xv = _mm256_set1_pd(x);
+    const unsigned lo = unsigned(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_load_pd(keys), xv, _CMP_LT_OQ)));
+    const unsigned hi = unsigned(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_load_pd(keys + 4), xv, _CMP_LT_OQ)));
+    return popcount(lo | hi << 4);
+#else
+    const __m128d xv = _mm_set1_pd(x);
+    unsigned mask = 0;
+    for(std::size_t i = 0; i < 4; ++i)
+        mask |= unsigned(_mm_movemask_pd(_mm_cmplt_pd(_mm_load_pd(keys + 2*i), xv))) << 2*i;
+    return popcount(mask);
+#endif
+}
+#endif
+
+/**
+ * @brief True if the keys can be compared in blocks with the < operator instead of the comparing function
+ *
+ * It is the case of the arithmetic keys ordered by the default comparator (default_less or a pointer to default_comparator).
+ */
+template <class K, class F>
+constexpr bool vectorizable = std::is_arithmetic<typename std::remove_const<K>::type>::value
+                              && (std::is_same<F, ::default_less<K>>::value || std::is_same<F, decltype(&::default_comparator<K>)>::value);
+}
+
+/**
+ * @brief A read-only static search tree (S-tree) for arithmetic keys, otherwise a FrozenTree
+ *
+ * This generic version is used when the keys are not arithmetic or are ordered by a custom comparing
+ * function: the vector comparisons are not possible and it is just the scalar FrozenTree.
+ *
+ * @tparam K the key type
+ * @tparam V the value type
+ * @tparam F the comparing function (default <)
+ */
+template <class K, class V, class F = ::default_less<K>, bool = simd::vectorizable<K,F>>
+class STree : public FrozenTree<K,V,F>
+{
+    public:
+    /** the search is scalar */
+    static constexpr bool vectorized = false;
+    using FrozenTree<K,V,F>::FrozenTree;
+};
+
+/**
+ * @brief A read-only static search tree (S-tree) for arithmetic keys
+ *
+ * The keys are stored in an implicit B-tree: every node is a cache line with B sorted keys (16 int or float,
+ * 8 double) and the children of the node k are the nodes k*(B+1)+i+1, for i from 0 to B. At every level the key
+ * is compared with the whole node at once with vector instructions (see simd::count_less()), and the number of
+ * keys less than it is directly the child to visit: one cache line and no unpredictable branches per level.
+ * The last node is filled with the greatest value of the type. As in VebTree, the entries are kept sorted in
+ * a separate array and reached through the rank of the found key.
+ *
+ * @tparam K the arithmetic key type
+ * @tparam V the value type
+ * @tparam F the comparing function, the default one
+ */
+template <class K, class V, class F>
+class STree<K,V,F,true>
+{
+    /** the pair with key and value */
+    using entry_type = std::pair<const K, V>;
+    /** the type of the copies of the keys */
+    using key_type = typename std::remove_const<K>::type;
+    /** number of keys in a node */
+    static constexpr std::size_t B = 64/sizeof(key_type) > 0 ? 64/sizeof(key_type) : 1;
+
+    /** a node of the implicit B-tree, one cache line */
+    struct alignas(64) Block
+    {
+        /** the sorted keys */
+        key_type keys[B];
+    };
+
+    /** the nodes, the root is the first one */
+    std::vector<Block> blocks;
+    /** the position in entries of every key, entries.size() for the padding */
+    std::vector<std::size_t> ranks;
+    /** the entries in sorted order */
+    std::vector<entry_type> entries;
+    /** The comparison operator, only used to check that it is the default one */
+    F cmp;
+
+    /** the index of the i-th child of the node k */
+    static std::size_t child(std::size_t k, std::size_t i) noexcept {return k*(B + 1) + i + 1;}
+    /**
+     * @brief Recursively fills the nodes in order
+     * @param k the node to fill
+     * @param next the next sorted position to place
+     */
+    void build(std::size_t k, std::size_t& next) noexcept;
+    /**
+     * @brief The search of the first key not less than the given one
+     * @param key the key to be searched
+     * @return std::size_t the position of the entry, entries.size() if there is none
+     */
+    std::size_t lower_bound(const K& key) const noexcept;
+
+    public:
+    /** the search uses vector comparisons */
+    static constexpr bool vectorized = true;
+    class ConstIterator;
+    /** an S-tree cannot be modified, so all its iterators are constant */
+    using Iterator = ConstIterator;
+
+    /**
+     * @brief Construct an empty STree
+     */
+    STree(F f = ::make_default_comparator<F,K>()): cmp{f} {}
+    /**
+     * @brief Construct an STree from a sorted sequence of entries, e.g. the iterators of a BinaryTree
+     *
+     * @throws std::invalid_argument if the comparing function is not the default one
+     * @param first iterator to the first entry
+     * @param last iterator past the last entry
+     * @param f the comparing function, it must be the default one
+     */
+    template <class It>
+    STree(It first, It last, F f = ::make_default_comparator<F,K>());
+
+    /**
+     * @brief The number of elements in the tree
+     *
+     * @return std::size_t the number of entries
+     */
+    std::size_t size() const noexcept {return entries.size();}
+
+    /**
+     * @brief Finds a value with a given key and returns an iterator to it
+     * @param key the key to be searched
+     * @return ConstIterator iterator to the entry with the key or to end() if its not present
+     */
+    ConstIterator find(const K& key) const;
+
+    /**
+     * @brief Finds many keys at once, faster than calling find() for each of them on a tree larger than the cache
+     *
+     * The keys are searched in groups of batch_width: the descents of a group go down one node together and
+     * every one prefetches its next node, so the cache misses of the different searches overlap.
+     * @param keys_in a range of keys, e.g. a std::vector<K>
+     * @param results_out an output iterator, a ConstIterator is written for every key in the same order (end() if it is not present)
+     * @return Out the output iterator past the last result
+     */
+    template <class KeyRange, class Out>
+    Out find_batch(const KeyRange& keys_in, Out results_out) const;
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * @throws runtime_errors if the key is not present, since the tree cannot be modified
+    * @tparam const K& the key of the searched value
+    * @return const V& reference to the value
+    */
+    const V& operator[](const K& key) const;
+
+    /**
+     * @brief Iterator to the smallest key
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator begin() const {return ConstIterator{entries.data()};}
+    /**
+     * @brief Iterator past the last entry
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator end() const {return ConstIterator{entries.data() + entries.size()};}
+    /**
+     * @brief Same as begin()
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator cbegin() const {return begin();}
+    /**
+     * @brief Same as end()
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator cend() const {return end();}
+};
+
+/**
+ * @brief In-order iterator over an STree, it just walks the sorted entries
+ */
+template <class K, class V, class F>
+class STree<K,V,F,true>::ConstIterator
+{
+    /** the pointed entry */
+    const std::pair<const K, V>* pointed;
+
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    ConstIterator(const std::pair<const K, V>* entry) : pointed{entry} {}
+    const std::pair<const K, V>& operator*() const {return *pointed;}
+    ConstIterator& operator++()
+    {
+        ++pointed;
+        return *this;
+    }
+    ConstIterator operator++(int)
+    {
+        ConstIterator it{*this};
+        ++(*this);
+        return it;
+    }
+    bool operator==(const ConstIterator& other) const noexcept {return pointed == other.pointed;}
+    bool operator!=(const ConstIterator& other) const noexcept {return !(*this == other);}
+};
+
+template <class K, class V, class F>
+template <class It>
+STree<K,V,F,true>::STree(It first, It last, F f) : entries(first, last), cmp{f}
+{
+    // a pointer can point to another function, while the function object is the < operator
+    if constexpr (std::is_pointer<F>::value)
+        if(cmp != F(&::default_comparator<K>))
+            throw std::invalid_argument("The S-tree compares the keys with the < operator");
+    const std::size_t n = entries.size();
+    blocks.resize((n + B - 1)/B);
+    ranks.assign(blocks.size()*B, n);
+    std::size_t next = 0;
+    build(0, next);
+}
+
+template <class K, class V, class F>
+void STree<K,V,F,true>::build(std::size_t k, std::size_t& next) noexcept
+{
+    if(k >= blocks.size()) return;
+    // the padding is greater than every key, but never found since its rank is n
+    const key_type padding = std::numeric_limits<key_type>::has_infinity ? std::numeric_limits<key_type>::infinity()
+                                                                        : std::numeric_limits<key_type>::max();
+    for(std::size_t i = 0; i < B; ++i)
+    {
+        build(child(k, i), next);
+        if(next < entries.size())
+        {
+            blocks[k].keys[i] = entries[next].first;
+            ranks[k*B + i] = next++;
+        }
+        else
+            blocks[k].keys[i] = padding;
+    }
+    build(child(k, B), next);
+}
+
+template <class K, class V, class F>
+std::size_t STree<K,V,F,true>::lower_bound(const K& key) const noexcept
+{
+    const std::size_t n = blocks.size();
+    std::size_t best = ranks.size();
+    std::size_t k = 0;
+    while(k < n)
+    {
+        const std::size_t i = simd::count_less<key_type, B>(blocks[k].keys, key);
+        // the first key not less than the searched one in the node is the candidate
+        best = i < B ? k*B + i : best;
+        k = child(k, i);
+    }
+    return best == ranks.size() ? entries.size() : ranks[best];
+}
+
+template <class K, class V, class F>
+typename STree<K,V,F,true>::ConstIterator STree<K,V,F,true>::find(const K& key) const
+{
+    std::size_t r = lower_bound(key);
+    if(r != entries.size() && !(key < entries[r].first))
+        return ConstIterator{entries.data() + r};
+    return end();
+}
+
+template <class K, class V, class F>
+template <class KeyRange, class Out>
+Out STree<K,V,F,true>::find_batch(const KeyRange& keys_in, Out results_out) const
+{
+    const std::size_t n = blocks.size();
+    auto key = std::begin(keys_in);
+    const auto last = std::end(keys_in);
+    key_type group[batch_width];
+    std::size_t best[batch_width];
+    std::size_t k[batch_width];
+    while(key != last)
+    {
+        std::size_t count = 0;
+        for(; count < batch_width && key != last; ++count, ++key)
+        {
+            group[count] = *key;
+            best[count] = ranks.size();
+            k[count] = 0;
+        }
+        for(bool active = true; active; )
+        {
+            active = false;
+            for(std::size_t j = 0; j < count; ++j)
+            {
+                if(k[j] >= n) continue;
+                const std::size_t i = simd::count_less<key_type, B>(blocks[k[j]].keys, group[j]);
+                best[j] = i < B ? k[j]*B + i : best[j];
+                k[j] = child(k[j], i);
+                // the next node is loaded while the other descents of the group are compared
+                layout::prefetch(blocks.data(), k[j]*sizeof(Block));
+                active = true;
+            }
+        }
+        for(std::size_t j = 0; j < count; ++j)
+        {
+            const std::size_t r = best[j] == ranks.size() ? entries.size() : ranks[best[j]];
+            *results_out++ = r != entries.size() && !(group[j] < entries[r].first) ? ConstIterator{entries.data() + r} : end();
+        }
+    }
+    return results_out;
+}
+
+template <class K, class V, class F>
+const V& STree<K,V,F,true>::operator[](const K& key) const
+{
+    std::size_t r = lower_bound(key);
+    if(r != entries.size() && !(key < entries[r].first))
+        return entries[r].second;
+    throw std::runtime_error("You are trying to acces a non existing key");
+}
+
+template <class k, class v, class f>
+std::ostream& operator<<(std::ostream& os, const STree<k,v,f,true>& st)
+{
+    for(const auto& vals : st)
+        os << "(" << vals.first << ":" << vals.second << ") ";
+    os << std::endl;
+    return os;
+}
+
+#endif
@@ -0,0 +1,364 @@
+/**
+ * @file VebTree.h
+ * @author Salvatore Milite and Davide Scassola
+ * @brief Read-only search tree in van Emde Boas layout
+ * @version 0.1
+ * @date 2019-01-17
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef __VEBTREE__
+#define __VEBTREE__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <cstddef>
+#include "BinaryTreeRec.h"
+#include "FrozenTree.h"
+
+/**
+ * @brief A read-only search tree whose keys are stored in van Emde Boas order
+ *
+ * The keys form a complete binary search tree of height h. The tree is cut at half height: the top
+ * tree is stored first, followed by the bottom trees one after the other, and every part is laid out
+ * recursively in the same way. Whatever the size of a cache line or of a page, a lookup then loads
+ * only O(log_B n) blocks of B keys, without knowing B: the same layout works on every machine.
+ *
+ * There are no child pointers. While descending, the position of a node is computed from the position
+ * of the root of the recursive subtree it belongs to, using three small tables indexed by depth
+ * (Brodal, Fagerberg and Jacob, "Cache oblivious search trees via binary trees of small height").
+ * The entries are kept sorted in a separate array, used by the iterators: only at the end of a lookup
+ * the rank of the found key is read to reach its entry.
+ *
+ * @tparam K the key type
+ * @tparam V the value type
+ * @tparam F the comparing function (default <)
+ */
+template <class K, class V, class F = ::default_less<K>>
+class VebTree
+{
+    /** the pair with key and value */
+    using entry_type = std::pair<const K, V>;
+    /** the type of the copies of the keys */
+    using key_type = typename std::remove_const<K>::type;
+    /** more levels than any tree that fits in memory */
+    static constexpr std::size_t max_levels = 64;
+
+    /** the keys in van Emde Boas order, the slots of the missing nodes of the last level are not used */
+    std::vector<key_type> keys;
+    /** the position in entries of every key */
+    std::vector<std::size_t> ranks;
+    /** the entries in sorted order */
+    std::vector<entry_type> entries;
+    /** number of levels */
+    std::size_t levels = 0;
+    /** for a level d, the size of the top tree of the cut just above it */
+    std::size_t top_size[max_levels + 2] = {};
+    /** for a level d, the size of each bottom tree of the cut just above it */
+    std::size_t bottom_size[max_levels + 2] = {};
+    /** for a level d, the level of the root of the subtree cut just above it */
+    std::size_t top_level[max_levels + 2] = {};
+    /** The comparison operator, a functional object that returns a boolean */
+    F cmp;
+
+    /**
+     * @brief Recursively fills the tables of the cuts of a subtree
+     * @param top the level of the root of the subtree (the root of the tree has level 1)
+     * @param height the number of levels of the subtree
+     */
+    void cut(std::size_t top, std::size_t height) noexcept;
+    /**
+     * @brief Recursively assigns the sorted positions to the nodes of the complete tree, in BFS numbering
+     */
+    static void in_order(std::vector<std::size_t>& order, std::size_t i, std::size_t& next) noexcept;
+    /**
+     * @brief The search of the first key not less than the given one
+     * @param key the key to be searched
+     * @return std::size_t the position of the entry, entries.size() if there is none
+     */
+    std::size_t lower_bound(const K& key) const;
+
+    public:
+    class ConstIterator;
+    /** a van Emde Boas tree cannot be modified, so all its iterators are constant */
+    using Iterator = ConstIterator;
+
+    /**
+     * @brief Construct an empty VebTree
+     */
+    VebTree(F f = ::make_default_comparator<F,K>()): cmp{f} {}
+    /**
+     * @brief Construct a VebTree from a sorted sequence of entries, e.g. the iterators of a BinaryTree
+     *
+     * @param first iterator to the first entry
+     * @param last iterator past the last entry
+     * @param f the comparing function, the sequence must be sorted according to it and have no duplicated keys
+     */
+    template <class It>
+    VebTree(It first, It last, F f = ::make_default_comparator<F,K>());
+
+    /**
+     * @brief The number of elements in the tree
+     *
+     * @return std::size_t the number of entries
+     */
+    std::size_t size() const noexcept {return entries.size();}
+
+    /**
+     * @brief Finds a value with a given key and returns an iterator to it
+     * @param key the key to be searched
+     * @return ConstIterator iterator to the entry with the key or to end() if its not present
+     */
+    ConstIterator find(const K& key) const;
+
+    /**
+     * @brief Finds many keys at once, faster than calling find() for each of them on a tree larger than the cache
+     *
+     * The keys are searched in groups of batch_width: the descents of a group go down one level together and
+     * every one prefetches its next node, so the cache misses of the different searches overlap.
+     * @param keys_in a range of keys, e.g. a std::vector<K>
+     * @param results_out an output iterator, a ConstIterator is written for every key in the same order (end() if it is not present)
+     * @return Out the output iterator past the last result
+     */
+    template <class KeyRange, class Out>
+    Out find_batch(const KeyRange& keys_in, Out results_out) const;
+
+    /**
+    * @brief operator that return the value corresponding to a given key
+    *
+    * @throws runtime_errors if the key is not present, since the tree cannot be modified
+    * @tparam const K& the key of the searched value
+    * @return const V& reference to the value
+    */
+    const V& operator[](const K& key) const;
+
+    /**
+     * @brief Iterator to the smallest key
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator begin() const {return ConstIterator{entries.data()};}
+    /**
+     * @brief Iterator past the last entry
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator end() const {return ConstIterator{entries.data() + entries.size()};}
+    /**
+     * @brief Same as begin()
+     * @return ConstIterator constant iterator to the first entry
+     */
+    ConstIterator cbegin() const {return begin();}
+    /**
+     * @brief Same as end()
+     * @return ConstIterator constant iterator to the end of the Data Structure
+     */
+    ConstIterator cend() const {return end();}
+
+    template <class k, class v, class f>
+    /**
+     * @brief Overloading of the operator<< for printing and writing on files
+     *
+     * @return std::ostream&
+     */
+    friend std::ostream& operator<<(std::ostream&, const VebTree<k,v,f>&);
+};
+
+/**
+ * @brief In-order iterator over a VebTree, it just walks the sorted entries
+ */
+template <class K, class V, class F>
+class VebTree<K,V,F>::ConstIterator
+{
+    /** the pointed entry */
+    const std::pair<const K, V>* pointed;
+
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    ConstIterator(const std::pair<const K, V>* entry) : pointed{entry} {}
+    const std::pair<const K, V>& operator*() const {return *pointed;}
+    ConstIterator& operator++()
+    {
+        ++pointed;
+        return *this;
+    }
+    ConstIterator operator++(int)
+    {
+        ConstIterator it{*this};
+        ++(*this);
+        return it;
+    }
+    bool operator==(const ConstIterator& other) const noexcept {return pointed == other.pointed;}
+    bool operator!=(const ConstIterator& other) const noexcept {return !(*this == other);}
+};
+
+template <class K, class V, class F>
+template <class It>
+VebTree<K,V,F>::VebTree(It first, It last, F f) : entries(first, last), cmp{f}
+{
+    const std::size_t n = entries.size();
+    if(n == 0) return;
+    while((std::size_t(1) << levels) <= n)
+        ++levels;
+    cut(1, levels);
+
+    // the sorted position of every node, in BFS numbering (the root is 1, the children of i are 2i and 2i+1)
+    std::vector<std::size_t> order(n + 1);
+    std::size_t next = 0;
+    in_order(order, 1, next);
+
+    // the position of every node in the layout: a node at level d is the root of a bottom tree
+    // of the cut above d, whose place follows the top tree and the bottom trees on its left
+    std::vector<std::size_t> position(n + 1);
+    const std::size_t slots = (std::size_t(1) << levels) - 1;
+    keys.assign(slots, entries[0].first);
+    ranks.assign(slots, n);
+    position[1] = 0;
+    std::size_t d = 1;
+    for(std::size_t i = 1; i <= n; ++i)
+    {
+        if(i == (std::size_t(1) << d)) ++d;
+        if(i > 1)
+        {
+            const std::size_t ancestor = i >> (d - top_level[d]);
+            position[i] = position[ancestor] + top_size[d] + (i & top_size[d])*bottom_size[d];
+        }
+        keys[position[i]] = entries[order[i]].first;
+        ranks[position[i]] = order[i];
+    }
+}
+
+template <class K, class V, class F>
+void VebTree<K,V,F>::cut(std::size_t top, std::size_t height) noexcept
+{
+    if(height <= 1) return;
+    // the bottom trees get the extra level when the height is odd
+    const std::size_t top_height = height/2;
+    const std::size_t d = top + top_height;
+    top_size[d] = (std::size_t(1) << top_height) - 1;
+    bottom_size[d] = (std::size_t(1) << (height - top_height)) - 1;
+    top_level[d] = top;
+    cut(top, top_height);
+    cut(d, height - top_height);
+}
+
+template <class K, class V, class F>
+void VebTree<K,V,F>::in_order(std::vector<std::size_t>& order, std::size_t i, std::size_t& next) noexcept
+{
+    if(i >= order.size()) return;
+    in_order(order, 2*i, next);
+    order[i] = next++;
+    in_order(order, 2*i + 1, next);
+}
+
+template <class K, class V, class F>
+std::size_t VebTree<K,V,F>::lower_bound(const K& key) const
+{
+    const std::size_t n = entries.size();
+    if(n == 0) return 0;
+    // the positions of the nodes met on the path, by level (the one below the leaves is computed but not used)
+    std::size_t position[max_levels + 2];
+    position[0] = 0;
+    position[1] = 0;
+    std::size_t best = keys.size();
+    std::size_t i = 1;
+    std::size_t d = 1;
+    while(i <= n)
+    {
+        const std::size_t p = position[d];
+        const bool right = cmp(keys[p], key);
+        // the last node not less than the key is the candidate
+        best = right ? best : p;
+        i = 2*i + right;
+        ++d;
+        position[d] = position[top_level[d]] + top_size[d] + (i & top_size[d])*bottom_size[d];
+    }
+    // only the rank of the result is read
+    return best == keys.size() ? n : ranks[best];
+}
+
+template <class K, class V, class F>
+typename VebTree<K,V,F>::ConstIterator VebTree<K,V,F>::find(const K& key) const
+{
+    std::size_t r = lower_bound(key);
+    if(r != entries.size() && !cmp(key, entries[r].first))
+        return ConstIterator{entries.data() + r};
+    return end();
+}
+
+template <class K, class V, class F>
+template <class KeyRange, class Out>
+Out VebTree<K,V,F>::find_batch(const KeyRange& keys_in, Out results_out) const
+{
+    const std::size_t n = entries.size();
+    auto key = std::begin(keys_in);
+    const auto last = std::end(keys_in);
+    decltype(key) group[batch_width];
+    // the state of every descent of the group, as in lower_bound()
+    std::size_t position[batch_width][max_levels + 2];
+    std::size_t best[batch_width];
+    std::size_t index[batch_width];
+    while(key != last)
+    {
+        std::size_t count = 0;
+        for(; count < batch_width && key != last; ++count, ++key)
+        {
+            group[count] = key;
+            position[count][0] = position[count][1] = 0;
+            best[count] = keys.size();
+            index[count] = 1;
+        }
+        // all the descents are at the same level d, until they leave the tree
+        for(std::size_t d = 1; d <= levels; ++d)
+        {
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                if(index[i] > n) continue;
+                const std::size_t p = position[i][d];
+                const bool right = cmp(keys[p], *group[i]);
+                best[i] = right ? best[i] : p;
+                index[i] = 2*index[i] + right;
+                const std::size_t next = position[i][top_level[d + 1]] + top_size[d + 1] + (index[i] & top_size[d + 1])*bottom_size[d + 1];
+                position[i][d + 1] = next;
+                // the next node is loaded while the other descents of the group are compared
+                if(index[i] <= n)
+                    layout::prefetch(keys.data(), next*sizeof(key_type));
+            }
+        }
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            const std::size_t r = best[i] == keys.size() ? n : ranks[best[i]];
+            *results_out++ = r != n && !cmp(*group[i], entries[r].first) ? ConstIterator{entries.data() + r} : end();
+        }
+    }
+    return results_out;
+}
+
+template <class K, class V, class F>
+const V& VebTree<K,V,F>::operator[](const K& key) const
+{
+    std::size_t r = lower_bound(key);
+    if(r != entries.size() && !cmp(key, entries[r].first))
+        return entries[r].second;
+    throw std::runtime_error("You are trying to acces a non existing key");
+}
+
+template <class k, class v, class f>
+std::ostream& operator<<(std::ostream& os, const VebTree<k,v,f>& vt)
+{
+    for(const auto& vals : vt)
+        os << "(" << vals.first << ":" << vals.second << ") ";
+    os << std::endl;
+    return os;
+}
+
+#endif
@@ -3,7 +3,17 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cmath>
+#include <limits>
 #include "BinaryTreeRec.h"
+#include "BTree.h"
+#include "FrozenTree.h"
+#include "VebTree.h"
+#include "STree.h"
+#include "NodePool.h"
+#include "CompactTree.h"
+#include "Interleave.h"
 #include "TestFunction.h"
 #include "catch.hpp"
 
@@ -38,6 +48,15 @@ TEST_CASE("Testing methos of class BT", "[BinaryTree]")
 		REQUIRE(bt2.find("a") == bt2.end());
 	}
 
+	SECTION("Testing the constant operator[]")
+	{
+		const BinaryTree<int,std::string>& cbt = bt;
+		for (int i = 0; i < 10; ++i)
+			REQUIRE(cbt[i] == values[i]);
+		REQUIRE_THROWS_AS(cbt[10], const std::runtime_error&);
+		REQUIRE(bt.size() == 10);
+	}
+
 	SECTION("Testing copy constructor")
 	{
 		pair_is p1{0, "a"};
@@ -183,3 +202,1594 @@ TEST_CASE("Testing methos of class BT", "[BinaryTree]")
 		REQUIRE(*(++bt_fun.begin()) == pSecond);
 	}
 }
+
+TEST_CASE("Testing the red-black balancing policy", "[BinaryTree][red_black]")
+{
+	BinaryTree<int,int,decltype(&default_comparator<int>),balancing::red_black> rb{};
+	const int n = 1000;
+	// ordered keys would produce a linked list without balancing
+	for (int i = 0; i < n; ++i)
+		REQUIRE(rb.insert(i, 2*i).second == true);
+	REQUIRE(rb.insert(10, 0).second == false);
+	REQUIRE(rb.size() == std::size_t(n));
+	SECTION("The height is logarithmic")
+	{
+		REQUIRE(rb.height(rb.root_get()) <= 2*std::log2(n + 1));
+	}
+	SECTION("The elements are found and iterated in order")
+	{
+		int expected = 0;
+		for (const auto& e : rb)
+		{
+			REQUIRE(e.first == expected);
+			REQUIRE(e.second == 2*expected);
+			++expected;
+		}
+		REQUIRE(expected == n);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(rb[i] == 2*i);
+	}
+	SECTION("The copy is independent and ordered")
+	{
+		auto copy = rb;
+		rb.clear();
+		REQUIRE(rb.size() == 0);
+		int expected = 0;
+		for (const auto& e : copy)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		REQUIRE(copy.height(copy.root_get()) <= 2*std::log2(n + 1));
+	}
+	SECTION("Descending and shuffled insertions")
+	{
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::red_black> down{}, shuffled{};
+		std::vector<int> keys;
+		for (int i = 0; i < n; ++i)
+		{
+			down.insert(n - i, i);
+			keys.push_back(i);
+		}
+		std::random_shuffle(keys.begin(), keys.end());
+		for (auto k : keys)
+			shuffled.insert(k, k);
+		REQUIRE(down.height(down.root_get()) <= 2*std::log2(n + 1));
+		REQUIRE(shuffled.height(shuffled.root_get()) <= 2*std::log2(n + 1));
+		int expected = 0;
+		for (const auto& e : shuffled)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+	}
+}
+
+TEST_CASE("Testing the AVL balancing policy", "[BinaryTree][avl]")
+{
+	using avl_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::avl>;
+	const int n = 1000;
+	avl_tree up{}, down{}, shuffled{};
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+	{
+		up.insert(i, i);
+		down.insert(n - 1 - i, i);
+		keys.push_back(i);
+	}
+	std::random_shuffle(keys.begin(), keys.end());
+	for (auto k : keys)
+		shuffled.insert(k, k);
+	SECTION("The trees are balanced after every kind of insertion")
+	{
+		REQUIRE(up.isBalanced(up.root_get()) == true);
+		REQUIRE(down.isBalanced(down.root_get()) == true);
+		REQUIRE(shuffled.isBalanced(shuffled.root_get()) == true);
+		REQUIRE(up.height(up.root_get()) <= 1.45*std::log2(n + 2));
+	}
+	SECTION("The elements are found and iterated in order")
+	{
+		int expected = 0;
+		for (const auto& e : shuffled)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		for (int i = 0; i < n; ++i)
+		{
+			REQUIRE(up[i] == i);
+			REQUIRE(down[i] == n - 1 - i);
+		}
+		REQUIRE(up.insert(5, 0).second == false);
+		REQUIRE(up.size() == std::size_t(n));
+	}
+}
+
+TEST_CASE("Testing the scapegoat balancing policy", "[BinaryTree][scapegoat]")
+{
+	using scapegoat_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::scapegoat>;
+	const int n = 1000;
+	const double alpha = 0.6;
+	scapegoat_tree up{&default_comparator<int>, balancing::scapegoat{alpha}}, shuffled{};
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+	{
+		up.insert(i, i);
+		keys.push_back(i);
+	}
+	std::random_shuffle(keys.begin(), keys.end());
+	for (auto k : keys)
+		shuffled.insert(k, k);
+	SECTION("The height stays logarithmic")
+	{
+		REQUIRE(up.height(up.root_get()) <= std::log(n)/std::log(1/alpha) + 1);
+		REQUIRE(shuffled.height(shuffled.root_get()) <= std::log(n)/std::log(1/0.7) + 1);
+	}
+	SECTION("The rebuilt subtrees keep order and links")
+	{
+		int expected = 0;
+		for (const auto& e : up)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		expected = 0;
+		for (const auto& e : shuffled)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(up[i] == i);
+		REQUIRE(up.size() == std::size_t(n));
+	}
+}
+
+TEST_CASE("Testing the splay balancing policy", "[BinaryTree][splay]")
+{
+	using splay_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::splay>;
+	const int n = 1000;
+	splay_tree st{};
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+		keys.push_back(i);
+	std::random_shuffle(keys.begin(), keys.end());
+	for (auto k : keys)
+	{
+		st.insert(k, k);
+		// the new node is moved to the root
+		REQUIRE(st.root_get()->entry.first == k);
+	}
+	SECTION("The accessed nodes are moved to the root")
+	{
+		REQUIRE((*st.find(42)).second == 42);
+		REQUIRE(st.root_get()->entry.first == 42);
+		REQUIRE(st[7] == 7);
+		REQUIRE(st.root_get()->entry.first == 7);
+		REQUIRE(st.insert(500, 0).second == false);
+		REQUIRE(st.root_get()->entry.first == 500);
+		// a missing key brings up the last visited node
+		REQUIRE(st.find(n + 10) == st.end());
+		REQUIRE(st.root_get()->entry.first == n - 1);
+	}
+	SECTION("The order and the links survive the rotations")
+	{
+		for (int i = 0; i < n; i += 3)
+			st.find(keys[i]);
+		int expected = 0;
+		for (const auto& e : st)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		REQUIRE(st.size() == std::size_t(n));
+	}
+}
+
+TEST_CASE("Testing the treap balancing policy", "[BinaryTree][treap]")
+{
+	using treap_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::treap>;
+	const int n = 1000;
+	treap_tree tt{};
+	for (int i = 0; i < n; ++i)
+		tt.insert(i, i);
+	SECTION("The ordered insertions do not degenerate")
+	{
+		REQUIRE(tt.height(tt.root_get()) <= 4*std::log2(n));
+		REQUIRE(tt.root_get()->size == std::size_t(n));
+		int expected = 0;
+		for (const auto& e : tt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+	}
+	SECTION("Split and join")
+	{
+		treap_tree right = tt.split(600);
+		REQUIRE(tt.size() == 600);
+		REQUIRE(right.size() == std::size_t(n - 600));
+		int expected = 0;
+		for (const auto& e : tt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == 600);
+		for (const auto& e : right)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		REQUIRE(tt.find(600) == tt.end());
+		REQUIRE(right.find(599) == right.end());
+		// an empty part
+		treap_tree empty = right.split(2*n);
+		REQUIRE(empty.size() == 0);
+		REQUIRE(empty.begin() == empty.end());
+		// the parts are still treaps
+		tt.insert(n, n);
+		REQUIRE_THROWS_AS(tt.join(std::move(right)), const std::invalid_argument&);
+		treap_tree last = tt.split(n);
+		tt.join(std::move(right));
+		tt.join(std::move(last));
+		REQUIRE(tt.size() == std::size_t(n + 1));
+		REQUIRE(right.size() == 0);
+		expected = 0;
+		for (const auto& e : tt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n + 1);
+		for (int i = 0; i <= n; ++i)
+			REQUIRE(tt[i] == i);
+		REQUIRE(tt.height(tt.root_get()) <= 4*std::log2(n));
+	}
+	SECTION("The parts of a split draw different priorities")
+	{
+		treap_tree right = tt.split(600);
+		// the same number of insertions in both parts
+		for (int i = 1; i <= 50; ++i)
+		{
+			tt.insert(-i, i);
+			right.insert(n + i, i);
+		}
+		// the priorities of the new nodes, in the order of their insertion
+		std::vector<unsigned> left_priorities(51), right_priorities(51);
+		std::vector<decltype(tt.root_get())> stack{tt.root_get(), right.root_get()};
+		while (!stack.empty())
+		{
+			auto node = stack.back();
+			stack.pop_back();
+			if (node == nullptr) continue;
+			if (node->entry.first < 0)
+				left_priorities[std::size_t(-node->entry.first)] = node->priority;
+			else if (node->entry.first > n)
+				right_priorities[std::size_t(node->entry.first - n)] = node->priority;
+			stack.push_back(node->_left.get());
+			stack.push_back(node->_right.get());
+		}
+		REQUIRE(left_priorities != right_priorities);
+		// not even the same sequence shifted
+		for (std::size_t i = 1; i <= 50; ++i)
+			REQUIRE(std::find(left_priorities.begin() + 1, left_priorities.end(), right_priorities[i]) == left_priorities.end());
+	}
+	SECTION("A copy draws other priorities than its source")
+	{
+		const treap_tree& source = tt;
+		treap_tree copy{source};
+		treap_tree assigned{};
+		assigned = source;
+		for (int i = 1; i <= 50; ++i)
+		{
+			tt.insert(n + i, i);
+			copy.insert(n + i, i);
+			assigned.insert(n + i, i);
+		}
+		// the priorities of the new nodes, in the order of their insertion
+		auto new_priorities = [n](const treap_tree& tree)
+		{
+			std::vector<unsigned> priorities(51);
+			std::vector<decltype(tree.root_get())> stack{tree.root_get()};
+			while (!stack.empty())
+			{
+				auto node = stack.back();
+				stack.pop_back();
+				if (node == nullptr) continue;
+				if (node->entry.first > n)
+					priorities[std::size_t(node->entry.first - n)] = node->priority;
+				stack.push_back(node->_left.get());
+				stack.push_back(node->_right.get());
+			}
+			return priorities;
+		};
+		const std::vector<unsigned> original = new_priorities(tt);
+		for (const treap_tree* other : {&copy, &assigned})
+		{
+			const std::vector<unsigned> drawn = new_priorities(*other);
+			for (std::size_t i = 1; i <= 50; ++i)
+				REQUIRE(std::find(original.begin() + 1, original.end(), drawn[i]) == original.end());
+		}
+		REQUIRE(new_priorities(copy) != new_priorities(assigned));
+	}
+}
+
+/**
+ * @brief The number of black nodes on every path to a leaf, -1 if the red-black invariants do not hold
+ */
+template <class Node>
+int black_height(const Node* node)
+{
+	if (node == nullptr) return 1;
+	const int left = black_height(node->_left.get()), right = black_height(node->_right.get());
+	if (left < 0 || left != right) return -1;
+	if (node->red && ((node->_left && node->_left->red) || (node->_right && node->_right->red))) return -1;
+	return left + (node->red ? 0 : 1);
+}
+
+TEST_CASE("Testing the in-place balance", "[BinaryTree][balance]")
+{
+	SECTION("Every size, the nodes are relinked and not copied")
+	{
+		for (int n = 0; n < 130; ++n)
+		{
+			BinaryTree<int,int> bt{};
+			std::vector<const std::pair<const int,int>*> entries;
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			for (const auto& e : bt)
+				entries.push_back(&e);
+			bt.balance();
+			REQUIRE(bt.size() == std::size_t(n));
+			REQUIRE(bt.isBalanced(bt.root_get()) == true);
+			// the smallest possible height
+			int levels = 0;
+			while ((1 << levels) - 1 < n)
+				++levels;
+			REQUIRE(bt.height(bt.root_get()) == levels);
+			std::size_t i = 0;
+			for (const auto& e : bt)
+			{
+				REQUIRE(&e == entries[i]);
+				REQUIRE(e.first == int(i++));
+			}
+			REQUIRE(i == std::size_t(n));
+			for (int k = 0; k < n; ++k)
+				REQUIRE(bt[k] == k);
+		}
+	}
+	SECTION("The policies are still valid after a balance")
+	{
+		const int n = 1000;
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::red_black> rb{};
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::avl> avl{};
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::treap> tt{};
+		for (int i = 0; i < n; ++i)
+		{
+			rb.insert(2*i, i);
+			avl.insert(2*i, i);
+			tt.insert(2*i, i);
+		}
+		rb.balance();
+		avl.balance();
+		tt.balance();
+		REQUIRE(black_height(rb.root_get()) > 0);
+		REQUIRE(tt.root_get()->size == std::size_t(n));
+		for (int i = 0; i < n; ++i)
+		{
+			rb.insert(2*i + 1, i);
+			avl.insert(2*i + 1, i);
+			tt.insert(2*i + 1, i);
+		}
+		REQUIRE(black_height(rb.root_get()) > 0);
+		REQUIRE(rb.height(rb.root_get()) <= 2*std::log2(2*n + 1));
+		REQUIRE(avl.isBalanced(avl.root_get()) == true);
+		REQUIRE(tt.root_get()->size == std::size_t(2*n));
+		REQUIRE(tt.height(tt.root_get()) <= 4*std::log2(2*n));
+		int expected = 0;
+		for (const auto& e : tt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == 2*n);
+	}
+}
+
+TEST_CASE("Testing the bulk build from a sorted range", "[BinaryTree][assign]")
+{
+	SECTION("Every size, balanced and linked in order")
+	{
+		for (int n = 0; n < 130; ++n)
+		{
+			std::vector<std::pair<int,int>> sorted;
+			for (int i = 0; i < n; ++i)
+				sorted.emplace_back(2*i, i);
+			BinaryTree<int,int> bt{sorted.begin(), sorted.end()};
+			REQUIRE(bt.size() == std::size_t(n));
+			REQUIRE(bt.isBalanced(bt.root_get()) == true);
+			int expected = 0;
+			for (const auto& e : bt)
+			{
+				REQUIRE(e.first == 2*expected);
+				REQUIRE(e.second == expected++);
+			}
+			REQUIRE(expected == n);
+			for (int i = 0; i < n; ++i)
+				REQUIRE(bt[2*i] == i);
+			REQUIRE(bt.find(1) == bt.end());
+		}
+	}
+	SECTION("From another tree, with a policy, then assigned again")
+	{
+		const int n = 1000;
+		BinaryTree<int,int> source{};
+		for (int i = 0; i < n; ++i)
+			source.insert(i, i);
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::red_black> rb{source.cbegin(), source.cend()};
+		BinaryTree<int,int,decltype(&default_comparator<int>),balancing::treap> tt{source.cbegin(), source.cend()};
+		REQUIRE(black_height(rb.root_get()) > 0);
+		REQUIRE(tt.root_get()->size == std::size_t(n));
+		for (int i = n; i < 2*n; ++i)
+		{
+			rb.insert(i, i);
+			tt.insert(i, i);
+		}
+		REQUIRE(black_height(rb.root_get()) > 0);
+		REQUIRE(tt.root_get()->size == std::size_t(2*n));
+		REQUIRE(tt.height(tt.root_get()) <= 4*std::log2(2*n));
+
+		BinaryTree<std::string,int,std::greater<std::string>> reversed{std::greater<std::string>{}};
+		std::vector<std::pair<std::string,int>> words{{"c", 3}, {"b", 2}, {"a", 1}};
+		reversed.assign(words.cbegin(), words.cend());
+		REQUIRE(reversed.size() == 3);
+		REQUIRE(reversed["a"] == 1);
+		REQUIRE((*reversed.begin()).first == "c");
+		reversed.assign(words.cend(), words.cend());
+		REQUIRE(reversed.size() == 0);
+		REQUIRE(reversed.begin() == reversed.end());
+	}
+}
+
+TEST_CASE("Testing the automatic rebalancing", "[BinaryTree][auto_balance]")
+{
+	const int n = 1000;
+	BinaryTree<int,int> bt{};
+	for (int i = 0; i < n; ++i)
+		bt.insert(i, i);
+	SECTION("Disabled by default")
+	{
+		for (int i = 0; i < 10; ++i)
+			REQUIRE(bt[n - 1] == n - 1);
+		REQUIRE(bt.counters().rebuilds == 0);
+		REQUIRE(bt.height(bt.root_get()) == n);
+	}
+	SECTION("The deep searches pay for a rebuild")
+	{
+		bt.auto_balance(2);
+		// 1000 levels against the 20 allowed: the second search brings the debt over the size
+		REQUIRE(bt[n - 1] == n - 1);
+		REQUIRE(bt.counters().rebuilds == 0);
+		REQUIRE(bt.counters().max_depth == std::size_t(n));
+		REQUIRE(bt.find(n) == bt.end());
+		REQUIRE(bt.counters().rebuilds == 1);
+		REQUIRE(bt.counters().relinked_nodes == std::size_t(n));
+		REQUIRE(bt.counters().max_depth == 10);
+		REQUIRE(bt.isBalanced(bt.root_get()) == true);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(bt[i] == i);
+		REQUIRE(bt.counters().rebuilds == 1);
+		// the ordered insertions degenerate again, but only the ones far from the limit are paid
+		for (int i = n; i < 2*n; ++i)
+			bt.insert(i, i);
+		REQUIRE(bt.counters().rebuilds > 1);
+		REQUIRE(bt.counters().rebuilds < 100);
+		REQUIRE(bt.size() == std::size_t(2*n));
+		int expected = 0;
+		for (const auto& e : bt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == 2*n);
+	}
+	SECTION("A deferred rebuild waits for idle()")
+	{
+		bt.auto_balance(2, true);
+		REQUIRE(bt.idle() == false);
+		bt.find(n - 1);
+		bt.find(n - 1);
+		REQUIRE(bt.counters().rebuilds == 0);
+		REQUIRE(bt.height(bt.root_get()) == n);
+		REQUIRE(bt.idle() == true);
+		REQUIRE(bt.counters().rebuilds == 1);
+		REQUIRE(bt.isBalanced(bt.root_get()) == true);
+		REQUIRE(bt.idle() == false);
+	}
+}
+
+/** a stateful allocator that counts the live allocations, to check that every node goes through it */
+template <class T>
+struct counting_allocator
+{
+	using value_type = T;
+	long* live;
+	explicit counting_allocator(long* counter) noexcept : live{counter} {}
+	template <class U>
+	counting_allocator(const counting_allocator<U>& other) noexcept : live{other.live} {}
+	T* allocate(std::size_t n) {++*live; return std::allocator<T>{}.allocate(n);}
+	void deallocate(T* p, std::size_t n) noexcept {--*live; std::allocator<T>{}.deallocate(p, n);}
+	template <class U>
+	bool operator==(const counting_allocator<U>& other) const noexcept {return live == other.live;}
+	template <class U>
+	bool operator!=(const counting_allocator<U>& other) const noexcept {return live != other.live;}
+};
+
+TEST_CASE("Testing the node allocators", "[BinaryTree][allocator]")
+{
+	const int n = 2000;
+	SECTION("Every node goes through a custom allocator")
+	{
+		long live = 0;
+		{
+			using counted_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::red_black,counting_allocator<std::pair<const int,int>>>;
+			counted_tree bt{default_comparator<int>, {}, counting_allocator<std::pair<const int,int>>{&live}};
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			REQUIRE(live == n);
+			counted_tree copy{bt};
+			REQUIRE(live == 2*n);
+			bt.balance();
+			REQUIRE(live == 2*n);
+			copy.clear();
+			REQUIRE(live == n);
+			copy = bt;
+			REQUIRE(live == 2*n);
+			REQUIRE(copy.get_allocator() == bt.get_allocator());
+		}
+		REQUIRE(live == 0);
+	}
+	SECTION("The nodes are carved from the blocks of a pool and reused")
+	{
+		node_pool pool{};
+		{
+			pmr::BinaryTree<int,int> bt{default_less<int>{}, {}, &pool};
+			for (int i = 0; i < n; ++i)
+				bt.insert((i*7919) % n, i);
+			REQUIRE(pool.slots_in_use() == std::size_t(n));
+			REQUIRE(pool.block_count() > 0);
+			REQUIRE(pool.reserved_bytes() >= n*pool.slot_size());
+			for (int i = 0; i < n; ++i)
+				REQUIRE(bt[(i*7919) % n] == i);
+			const std::size_t blocks = pool.block_count();
+			// the freed nodes are taken again without new blocks
+			bt.clear();
+			REQUIRE(pool.slots_in_use() == 0);
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			REQUIRE(pool.block_count() == blocks);
+			// a copy in the same pool, and one with the default resource
+			pmr::BinaryTree<int,int> same{bt, &pool};
+			pmr::BinaryTree<int,int> other{bt};
+			REQUIRE(pool.slots_in_use() == std::size_t(2*n));
+			REQUIRE(other.get_allocator().resource() == std::pmr::get_default_resource());
+			same.balance();
+			int expected = 0;
+			for (const auto& e : same)
+				REQUIRE(e.first == expected++);
+			REQUIRE(expected == n);
+		}
+		REQUIRE(pool.slots_in_use() == 0);
+		pool.release();
+		REQUIRE(pool.block_count() == 0);
+	}
+	SECTION("The blocks of a pool can be on huge pages")
+	{
+		huge_page_resource huge{};
+		{
+			node_pool pool{1 << 14, 1 << 16, &huge};
+			pmr::BinaryTree<int,int> bt{default_less<int>{}, {}, &pool};
+			for (int i = 0; i < 20*n; ++i)
+				bt.insert((i*7919) % (20*n), i);
+			bt.balance();
+			for (int i = 0; i < 20*n; ++i)
+				REQUIRE(bt[(i*7919) % (20*n)] == i);
+			REQUIRE(pool.block_count() == 2);
+			REQUIRE(huge.reserved_huge_blocks() <= 2);
+		}
+		REQUIRE(huge.huge_page_size() == std::size_t(1) << 21);
+	}
+	SECTION("Any memory resource, and treaps joined only with the same one")
+	{
+		std::pmr::monotonic_buffer_resource arena;
+		pmr::BinaryTree<std::string,int,decltype(&default_comparator<std::string>),balancing::treap> tt{default_comparator<std::string>, {}, &arena};
+		for (int i = 0; i < n; ++i)
+			tt.insert(std::to_string(i), i);
+		auto right = tt.split("5");
+		REQUIRE(right.get_allocator() == tt.get_allocator());
+		tt.join(std::move(right));
+		REQUIRE(tt.size() == std::size_t(n));
+		pmr::BinaryTree<std::string,int,decltype(&default_comparator<std::string>),balancing::treap> elsewhere{};
+		elsewhere.insert("6", 6);
+		REQUIRE_THROWS_AS(tt.join(std::move(elsewhere)), const std::invalid_argument&);
+		REQUIRE(tt["1999"] == 1999);
+	}
+}
+
+// an arena that counts the nodes given back one by one
+class counting_arena : public std::pmr::monotonic_buffer_resource
+{
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+	{
+		++freed;
+		std::pmr::monotonic_buffer_resource::do_deallocate(p, bytes, alignment);
+	}
+	public:
+	long freed = 0;
+};
+
+// a resource on the heap that counts the bytes in use
+class counting_resource : public std::pmr::memory_resource
+{
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		void* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		live += long(bytes);
+		return p;
+	}
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+	{
+		live -= long(bytes);
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {return this == &other;}
+	public:
+	long live = 0;
+};
+
+TEST_CASE("Testing the teardown", "[BinaryTree][clear]")
+{
+	SECTION("A degenerate tree is freed without recursion")
+	{
+		// the splayed ascending keys form a path of left children
+		const int n = 1000000;
+		long live = 0;
+		{
+			using splay_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::splay,counting_allocator<std::pair<const int,int>>>;
+			splay_tree bt{default_comparator<int>, {}, counting_allocator<std::pair<const int,int>>{&live}};
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			REQUIRE(live == n);
+			bt.clear();
+			REQUIRE(live == 0);
+			REQUIRE(bt.size() == 0);
+			REQUIRE(bt.begin() == bt.end());
+			splay_tree other{bt};
+			other.insert(1, 1);
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			// the old nodes are freed by the move assignment
+			bt = std::move(other);
+			REQUIRE(live == 1);
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+		}
+		REQUIRE(live == 0);
+	}
+	SECTION("The nodes of an arena are visited only if they have something to destroy")
+	{
+		counting_arena arena;
+		{
+			pmr::BinaryTree<int,double> trivial{default_less<int>{}, {}, &arena};
+			pmr::BinaryTree<int,std::string> strings{default_less<int>{}, {}, &arena};
+			for (int i = 0; i < 1000; ++i)
+			{
+				trivial.insert(i, i);
+				strings.insert(i, std::to_string(i));
+			}
+			trivial.clear();
+			REQUIRE(arena.freed == 0);
+			REQUIRE(trivial.begin() == trivial.end());
+			trivial.insert(1, 1.5);
+			REQUIRE(trivial[1] == 1.5);
+		}
+		REQUIRE(arena.freed == 1000);
+	}
+	SECTION("A tree moved onto one with another resource gets copies of the entries")
+	{
+		counting_arena arena;
+		counting_resource heap;
+		{
+			using splay_tree = pmr::BinaryTree<int,double,default_less<int>,balancing::splay>;
+			splay_tree moved{default_less<int>{}, {}, &heap};
+			for (int i = 0; i < 1000; ++i)
+				moved.insert(i, i);
+			splay_tree target{default_less<int>{}, {}, &arena};
+			target = std::move(moved);
+			REQUIRE(moved.size() == 0);
+			REQUIRE(heap.live == 0);
+			REQUIRE(target.size() == 1000);
+			REQUIRE(target[500] == 500);
+			// the splayed root is a node of the arena, like all the others, so the tree is released in bulk
+			target.insert(1000, 1000);
+			target.clear();
+			REQUIRE(arena.freed == 0);
+		}
+		REQUIRE(heap.live == 0);
+	}
+}
+
+TEST_CASE("Testing the recycling of the nodes", "[BinaryTree][reserve]")
+{
+	const int n = 2000;
+	long live = 0;
+	{
+		using counted_tree = BinaryTree<int,int,decltype(&default_comparator<int>),balancing::avl,counting_allocator<std::pair<const int,int>>>;
+		counted_tree bt{default_comparator<int>, {}, counting_allocator<std::pair<const int,int>>{&live}};
+		SECTION("Without reserve() the freed nodes go back to the allocator")
+		{
+			for (int i = 0; i < n; ++i)
+				bt.insert(i, i);
+			bt.clear();
+			REQUIRE(live == 0);
+			REQUIRE(bt.recycling().reused == 0);
+			REQUIRE(bt.recycling().allocated == std::size_t(n));
+		}
+		SECTION("The cleared nodes are taken again by insert() and the copies")
+		{
+			bt.reserve(n);
+			REQUIRE(live == n);
+			for (int round = 0; round < 3; ++round)
+			{
+				for (int i = 0; i < n; ++i)
+					bt.insert((i*7919) % n, round);
+				REQUIRE(live == n);
+				REQUIRE(bt[n/2] == round);
+				bt.balance();
+				REQUIRE(live == n);
+				bt.clear();
+				REQUIRE(live == n);
+			}
+			REQUIRE(bt.recycling().allocated == 0);
+			REQUIRE(bt.recycling().hit_rate() == 1.0);
+			counted_tree other{default_comparator<int>, {}, counting_allocator<std::pair<const int,int>>{&live}};
+			for (int i = 0; i < n/2; ++i)
+				other.insert(i, -i);
+			bt = other;
+			REQUIRE(live == n + n/2);
+			REQUIRE(bt[n/2 - 1] == 1 - n/2);
+			// the cap keeps the free list from growing beyond n nodes
+			for (int i = n/2; i < 2*n; ++i)
+				bt.insert(i, i);
+			REQUIRE(bt.recycling().allocated == std::size_t(n/2 + n/2));
+			bt.clear();
+			REQUIRE(live == n + n/2);
+			bt.shrink_to_fit();
+			REQUIRE(live == n/2);
+			bt.insert(1, 1);
+			bt.clear();
+			REQUIRE(live == n/2);
+		}
+	}
+	REQUIRE(live == 0);
+}
+
+// the number of nodes that follow the previous one in memory, visited in pre-order or breadth-first
+template<class Node>
+int adjacent_nodes(const Node* root, bool breadth_first, std::size_t slot)
+{
+	std::vector<const Node*> visits{root};
+	for (std::size_t i = 0; i < visits.size(); ++i)
+	{
+		const Node* node = visits[i];
+		if (breadth_first)
+		{
+			if (node->_left) visits.push_back(node->_left.get());
+			if (node->_right) visits.push_back(node->_right.get());
+		}
+	}
+	if (!breadth_first)
+	{
+		visits.clear();
+		std::vector<const Node*> pending{root};
+		while (!pending.empty())
+		{
+			const Node* node = pending.back();
+			pending.pop_back();
+			visits.push_back(node);
+			if (node->_right) pending.push_back(node->_right.get());
+			if (node->_left) pending.push_back(node->_left.get());
+		}
+	}
+	int adjacent = 0;
+	for (std::size_t i = 1; i < visits.size(); ++i)
+		adjacent += reinterpret_cast<const char*>(visits[i]) == reinterpret_cast<const char*>(visits[i-1]) + slot;
+	return adjacent;
+}
+
+TEST_CASE("Testing the compaction of the nodes", "[BinaryTree][compact]")
+{
+	const int n = 5000;
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+		keys.push_back(i);
+	std::random_shuffle(keys.begin(), keys.end());
+	using avl_tree = pmr::BinaryTree<int,int,decltype(&default_comparator<int>),balancing::avl>;
+	for (bool breadth_first : {false, true})
+	{
+		node_pool pool{};
+		avl_tree bt{default_comparator<int>, {}, &pool};
+		for (auto k : keys)
+			bt.insert(k, 2*k);
+		const int height = bt.height(bt.root_get());
+		bt.compact(breadth_first ? avl_tree::order::breadth_first : avl_tree::order::pre_order);
+		REQUIRE(bt.size() == std::size_t(n));
+		REQUIRE(bt.height(bt.root_get()) == height);
+		REQUIRE(bt.isBalanced(bt.root_get()));
+		// the new nodes are consecutive slots of the pool, apart from the jumps between its blocks
+		REQUIRE(adjacent_nodes(bt.root_get(), breadth_first, pool.slot_size()) >= n - 1 - int(pool.block_count()));
+		REQUIRE(pool.slots_in_use() == std::size_t(n));
+		int expected = 0;
+		for (const auto& e : bt)
+		{
+			REQUIRE(e.first == expected);
+			REQUIRE(e.second == 2*expected++);
+		}
+		REQUIRE(expected == n);
+		for (auto k : keys)
+			REQUIRE(bt[k] == 2*k);
+		// the heights are still there for the next insertions
+		for (int i = n; i < n + 100; ++i)
+			bt.insert(i, 2*i);
+		REQUIRE(bt.isBalanced(bt.root_get()));
+	}
+	avl_tree empty{};
+	empty.compact();
+	REQUIRE(empty.begin() == empty.end());
+}
+
+// a comparing function that counts its calls, with or without a three-way compare()
+template<bool three_way>
+struct counting_less
+{
+	long* calls;
+	bool operator()(const std::string& a, const std::string& b) const {++*calls; return a < b;}
+	template<bool enabled = three_way, class = std::enable_if_t<enabled>>
+	int compare(const std::string& a, const std::string& b) const {++*calls; return a.compare(b);}
+};
+
+TEST_CASE("Testing the comparing functions", "[BinaryTree][comparator]")
+{
+	SECTION("The default function object and its three-way comparison")
+	{
+		REQUIRE(default_less<int>{}(1, 2));
+		REQUIRE_FALSE(default_less<int>{}(2, 2));
+		REQUIRE(default_less<int>{}.compare(1, 2) < 0);
+		REQUIRE(default_less<int>{}.compare(2, 2) == 0);
+		REQUIRE(default_less<double>{}.compare(3.5, 2) > 0);
+		REQUIRE(default_less<std::string>{}.compare("abc", "abd") < 0);
+		REQUIRE(default_less<std::string>{}.compare("b", "abc") > 0);
+		REQUIRE((has_three_way<default_less<std::string>,std::string>::value));
+		REQUIRE_FALSE((has_three_way<decltype(&default_comparator<int>),int>::value));
+		REQUIRE_FALSE((has_three_way<counting_less<false>,std::string>::value));
+		REQUIRE((has_three_way<counting_less<true>,std::string>::value));
+	}
+	SECTION("The function pointers still work, also without giving the function")
+	{
+		BinaryTree<int,int,decltype(&default_comparator<int>)> bt{};
+		CompactTree<int,int,decltype(&default_comparator<int>)> ct{};
+		for (int i = 0; i < 100; ++i)
+		{
+			bt.insert((i*37) % 100, i);
+			ct.insert((i*37) % 100, i);
+		}
+		int expected = 0;
+		for (const auto& e : bt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(ct[37] == 1);
+		REQUIRE((STree<int,int,decltype(&default_comparator<int>)>::vectorized));
+		REQUIRE((STree<int,int>::vectorized));
+	}
+	SECTION("A three-way comparison is called once for every level")
+	{
+		long two_way_calls = 0, three_way_calls = 0;
+		BinaryTree<std::string,int,counting_less<false>,balancing::red_black> two_way{counting_less<false>{&two_way_calls}};
+		BinaryTree<std::string,int,counting_less<true>,balancing::red_black> three_way{counting_less<true>{&three_way_calls}};
+		for (int i = 0; i < 1000; ++i)
+		{
+			two_way.insert(std::to_string(i), i);
+			three_way.insert(std::to_string(i), i);
+		}
+		two_way_calls = three_way_calls = 0;
+		for (int i = 0; i < 1000; ++i)
+		{
+			REQUIRE(two_way[std::to_string(i)] == i);
+			REQUIRE(three_way[std::to_string(i)] == i);
+		}
+		// one call per visited node, at most 2*log2(1001) of them
+		REQUIRE(three_way_calls <= 1000*20);
+		REQUIRE(two_way_calls > three_way_calls);
+	}
+}
+
+// a transparent comparing function between int keys and a type that can not be turned into an int
+struct boxed { int inside; };
+struct boxed_less
+{
+	using is_transparent = void;
+	bool operator()(int a, int b) const {return a < b;}
+	bool operator()(const boxed& a, int b) const {return a.inside < b;}
+	bool operator()(int a, const boxed& b) const {return a < b.inside;}
+};
+
+TEST_CASE("Testing the heterogeneous lookups", "[BinaryTree][transparent]")
+{
+	SECTION("Strings found through views and C strings")
+	{
+		BinaryTree<std::string,int,default_less<>,balancing::red_black> bt{};
+		for (int i = 0; i < 100; ++i)
+			bt.insert(std::to_string(i*2), i);
+		const char buffer[] = "42 and more";
+		std::string_view view{buffer, 2};
+		REQUIRE(bt.find(view) != bt.end());
+		REQUIRE((*bt.find(view)).second == 21);
+		REQUIRE(bt.find("43") == bt.end());
+		REQUIRE(bt.contains(view));
+		REQUIRE_FALSE(bt.contains("43"));
+		REQUIRE(bt.count(view) == 1);
+		REQUIRE(bt.count(std::string_view{"7"}) == 0);
+		// the first key not less than "43" is "44"
+		REQUIRE((*bt.lower_bound("43")).first == "44");
+		REQUIRE((*bt.lower_bound(view)).first == "42");
+		REQUIRE(bt.lower_bound("999") == bt.end());
+		const auto& cbt = bt;
+		REQUIRE((*cbt.lower_bound(std::string_view{"0"})).first == "0");
+		REQUIRE((*cbt.lower_bound(std::string{"1"})).first == "10");
+	}
+	SECTION("The lookups with the keys themselves")
+	{
+		BinaryTree<int,int> bt{};
+		for (int i = 0; i < 100; i += 3)
+			bt.insert(i, i);
+		REQUIRE(bt.contains(99));
+		REQUIRE_FALSE(bt.contains(100));
+		REQUIRE(bt.count(3) == 1);
+		REQUIRE(bt.count(4) == 0);
+		REQUIRE((*bt.lower_bound(4)).first == 6);
+		REQUIRE((*bt.lower_bound(-5)).first == 0);
+		REQUIRE(bt.lower_bound(100) == bt.end());
+		BinaryTree<int,int> empty{};
+		REQUIRE(empty.lower_bound(1) == empty.end());
+		REQUIRE_FALSE(empty.contains(1));
+	}
+	SECTION("Objects that can not become keys")
+	{
+		BinaryTree<int,int,boxed_less,balancing::splay> bt{};
+		for (int i = 0; i < 100; ++i)
+			bt.insert((i*37) % 100, i);
+		REQUIRE((*bt.find(boxed{37})).second == 1);
+		// the splay moved the found node to the root
+		REQUIRE(bt.find(boxed{37}) == bt.find(37));
+		REQUIRE(bt.find(boxed{100}) == bt.end());
+		REQUIRE(bt.contains(boxed{0}));
+		REQUIRE(bt.count(boxed{-1}) == 0);
+		REQUIRE((*bt.lower_bound(boxed{50})).first == 50);
+		int expected = 0;
+		for (const auto& e : bt)
+			REQUIRE(e.first == expected++);
+	}
+}
+
+TEST_CASE("Testing the memory usage", "[BinaryTree][memory_usage]")
+{
+	const int n = 1000;
+	BinaryTree<int,double> bt{};
+	REQUIRE(bt.memory_usage().nodes == 0);
+	REQUIRE(bt.memory_usage().bytes_per_entry() == 0);
+	for (int i = 0; i < n; ++i)
+		bt.insert((i*7919) % n, i);
+	auto usage = bt.memory_usage();
+	REQUIRE(usage.nodes == std::size_t(n));
+	REQUIRE(usage.node_bytes >= n*(sizeof(int) + sizeof(double) + 3*sizeof(void*)));
+	// a malloc chunk of at least a header word
+	REQUIRE(usage.slack >= n*sizeof(void*));
+	REQUIRE(usage.bytes_per_entry() == Approx(double(usage.node_bytes + usage.slack)/n));
+	// the spare nodes are slack
+	bt.reserve(2*n);
+	REQUIRE(bt.memory_usage().node_bytes == usage.node_bytes);
+	REQUIRE(bt.memory_usage().slack >= usage.slack + usage.node_bytes);
+	bt.clear();
+	REQUIRE(bt.memory_usage().node_bytes == 0);
+	REQUIRE(bt.memory_usage().slack >= 2*usage.node_bytes);
+	// a pool is exact
+	node_pool pool{};
+	pmr::BinaryTree<int,double> pooled{default_less<int>{}, {}, &pool};
+	for (int i = 0; i < n; ++i)
+		pooled.insert(i, i);
+	REQUIRE(pooled.memory_usage().node_bytes == n*pool.slot_size());
+	REQUIRE(pooled.memory_usage().slack == 0);
+	// the links do not carry the allocator: a node takes the same bytes with a polymorphic one
+	REQUIRE(pooled.memory_usage().node_bytes == usage.node_bytes);
+}
+
+// a value that counts its instances and whose copy throws when the allowed copies are over
+struct fragile
+{
+	static int alive;
+	static int copies_left;
+	int value;
+	fragile(int v = 0) : value{v} {++alive;}
+	fragile(const fragile& other) : value{other.value}
+	{
+		if (copies_left-- == 0) throw std::runtime_error("copy failed");
+		++alive;
+	}
+	fragile& operator=(const fragile&) = default;
+	~fragile() {--alive;}
+	friend bool operator<(const fragile& a, const fragile& b) {return a.value < b.value;}
+};
+int fragile::alive = 0;
+int fragile::copies_left = 0;
+
+TEST_CASE("Testing the B-tree backend", "[BTree]")
+{
+	// small nodes, to have many levels with few elements
+	using small_btree = BTree<int,int,decltype(&default_comparator<int>),128>;
+	const int n = 5000;
+	small_btree bt{};
+	BTree<std::string,double> bt2{};
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+		keys.push_back(i);
+	std::random_shuffle(keys.begin(), keys.end());
+	for (auto k : keys)
+	{
+		REQUIRE(bt.insert(k, 2*k).second == true);
+		bt2.insert(std::to_string(k), k + 0.1);
+	}
+	SECTION("Insert, find and operator[]")
+	{
+		REQUIRE(bt.size() == std::size_t(n));
+		REQUIRE(bt.insert(7, 0).second == false);
+		REQUIRE((*bt.insert(7, 0).first).second == 14);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(bt[i] == 2*i);
+		REQUIRE(bt.find(n) == bt.end());
+		REQUIRE(bt2["42"] == 42.1);
+		REQUIRE(bt2["baobab"] == 0.0);
+		REQUIRE(bt2.size() == std::size_t(n + 1));
+		const small_btree& cbt = bt;
+		REQUIRE(cbt[3] == 6);
+		REQUIRE_THROWS_AS(cbt[-1], const std::runtime_error&);
+	}
+	SECTION("The iterators visit the keys in order")
+	{
+		int expected = 0;
+		for (const auto& e : bt)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		std::string previous;
+		for (auto it = bt2.cbegin(); it != bt2.cend(); ++it)
+		{
+			REQUIRE(previous < (*it).first);
+			previous = (*it).first;
+		}
+	}
+	SECTION("Copy, move and clear")
+	{
+		small_btree copy{bt};
+		bt.clear();
+		REQUIRE(bt.size() == 0);
+		REQUIRE(bt.begin() == bt.end());
+		REQUIRE(bt.find(1) == bt.end());
+		int expected = 0;
+		for (const auto& e : copy)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		small_btree moved = std::move(copy);
+		REQUIRE(copy.size() == 0);
+		REQUIRE(moved[n - 1] == 2*(n - 1));
+		bt = moved;
+		REQUIRE(bt.size() == std::size_t(n));
+		REQUIRE(&(*bt.find(1)) != &(*moved.find(1)));
+	}
+	SECTION("Self-assignment keeps the entries")
+	{
+		small_btree& same = bt;
+		bt = same;
+		REQUIRE(bt.size() == std::size_t(n));
+		REQUIRE(bt[n - 1] == 2*(n - 1));
+		bt = std::move(same);
+		REQUIRE(bt.size() == std::size_t(n));
+		REQUIRE(bt[0] == 0);
+	}
+	SECTION("A copy that throws frees what it built and leaves the target as it was")
+	{
+		{
+			using fragile_btree = BTree<int,fragile,default_less<int>,128>;
+			fragile_btree source{};
+			fragile::copies_left = 1000000;
+			for (int i = 0; i < 1000; ++i)
+				source.insert(i, fragile{i});
+			const int before = fragile::alive;
+			fragile_btree target{};
+			target.insert(-1, fragile{-1});
+			fragile::copies_left = 500;
+			REQUIRE_THROWS_AS(fragile_btree{source}, const std::runtime_error&);
+			REQUIRE(fragile::alive == before + 1);
+			fragile::copies_left = 500;
+			REQUIRE_THROWS_AS(target = source, const std::runtime_error&);
+			REQUIRE(fragile::alive == before + 1);
+			REQUIRE(target.size() == 1);
+			REQUIRE(target[-1].value == -1);
+			fragile::copies_left = 1000000;
+		}
+		REQUIRE(fragile::alive == 0);
+	}
+	SECTION("An insertion whose key copy throws leaves the tree as it was")
+	{
+		{
+			using fragile_keys = BTree<fragile,int,default_less<fragile>,128>;
+			fragile_keys tree{};
+			fragile::copies_left = 1000000;
+			for (int i = 0; i < 2000; i += 2)
+				tree.insert(fragile{i}, i);
+			// every odd key fails at each copy in turn, then it goes in: in place, with a split, or with a new root
+			for (int k = 1; k < 2000; k += 6)
+			{
+				const std::size_t size = tree.size();
+				for (int copies = 0; ; ++copies)
+				{
+					const int before = fragile::alive;
+					fragile::copies_left = copies;
+					try
+					{
+						tree.insert(fragile{k}, k);
+						break;
+					}
+					catch (const std::runtime_error&)
+					{
+						REQUIRE(fragile::alive == before);
+						REQUIRE(tree.size() == size);
+					}
+				}
+				fragile::copies_left = 1000000;
+				REQUIRE(tree.size() == size + 1);
+				REQUIRE(tree[fragile{k}] == k);
+			}
+			int previous = -1;
+			std::size_t count = 0;
+			for (const auto& e : tree)
+			{
+				REQUIRE(previous < e.first.value);
+				REQUIRE(e.second == e.first.value);
+				previous = e.first.value;
+				++count;
+			}
+			REQUIRE(count == tree.size());
+		}
+		REQUIRE(fragile::alive == 0);
+	}
+	SECTION("Custom comparison function")
+	{
+		BTree<int,int,std::greater<int>> reversed{std::greater<int>{}};
+		for (auto k : keys)
+			reversed.insert(k, k);
+		REQUIRE((*reversed.begin()).first == n - 1);
+		REQUIRE((*(++reversed.begin())).first == n - 2);
+	}
+}
+
+TEST_CASE("Testing the compact index tree", "[CompactTree]")
+{
+	const int n = 5000;
+	std::vector<int> keys;
+	for (int i = 0; i < n; ++i)
+		keys.push_back(i);
+	std::vector<int> shuffled{keys};
+	std::random_shuffle(shuffled.begin(), shuffled.end());
+	CompactTree<int,int> ct{};
+	for (auto k : shuffled)
+		REQUIRE(ct.insert(k, 2*k).second == true);
+	SECTION("Insert, find and operator[]")
+	{
+		REQUIRE(ct.size() == std::size_t(n));
+		REQUIRE(ct.insert(7, 0).second == false);
+		REQUIRE((*ct.insert(7, 0).first).second == 14);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(ct[i] == 2*i);
+		REQUIRE(ct.find(n) == ct.end());
+		REQUIRE(ct[n] == 0);
+		REQUIRE(ct.size() == std::size_t(n + 1));
+		const CompactTree<int,int>& cct = ct;
+		REQUIRE(cct[3] == 6);
+		REQUIRE((*cct.find(4)).second == 8);
+		REQUIRE_THROWS_AS(cct[-1], const std::runtime_error&);
+		CompactTree<std::string,double> ct2{};
+		ct2.insert(std::make_pair(std::string{"baobab"}, 1.5));
+		REQUIRE(ct2["baobab"] == 1.5);
+		REQUIRE(ct2["acacia"] == 0.0);
+		REQUIRE((*ct2.begin()).first == "acacia");
+	}
+	SECTION("The iterators visit the keys in order, also after sorted insertions")
+	{
+		int expected = 0;
+		for (const auto& e : ct)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		CompactTree<int,int> ascending{}, descending{};
+		for (int i = 0; i < n; ++i)
+		{
+			ascending.insert(i, i);
+			descending.insert(n - 1 - i, i);
+		}
+		expected = 0;
+		for (auto it = descending.cbegin(); it != descending.cend(); it++)
+			REQUIRE((*it).first == expected++);
+		REQUIRE(expected == n);
+		REQUIRE(std::equal(ascending.begin(), ascending.end(), ct.begin(),
+		        [](const std::pair<const int,int>& a, const std::pair<const int,int>& b){return a.first == b.first;}));
+	}
+	SECTION("The iterators survive the growth of the nodes")
+	{
+		CompactTree<int,int> small{};
+		auto it = small.insert(10, 1).first;
+		for (int i = 11; i < 1000; ++i)
+			small.insert(i, i);
+		REQUIRE((*it).first == 10);
+		REQUIRE((*(++it)).first == 11);
+		small.reserve(2000);
+		const std::pair<const int,int>* entry = &(*small.find(500));
+		for (int i = 0; i < 10; ++i)
+			small.insert(i, i);
+		REQUIRE(entry == &(*small.find(500)));
+	}
+	SECTION("Copy, move and clear")
+	{
+		CompactTree<int,int> copy{ct};
+		ct.clear();
+		REQUIRE(ct.size() == 0);
+		REQUIRE(ct.begin() == ct.end());
+		REQUIRE(ct.find(1) == ct.end());
+		int expected = 0;
+		for (const auto& e : copy)
+			REQUIRE(e.first == expected++);
+		REQUIRE(expected == n);
+		CompactTree<int,int> moved = std::move(copy);
+		REQUIRE(copy.size() == 0);
+		REQUIRE(copy.begin() == copy.end());
+		REQUIRE(moved[n - 1] == 2*(n - 1));
+		ct = moved;
+		REQUIRE(ct.size() == std::size_t(n));
+		REQUIRE(&(*ct.find(1)) != &(*moved.find(1)));
+		ct.insert(-1, 0);
+		REQUIRE((*ct.begin()).first == -1);
+	}
+	SECTION("Values out of the nodes")
+	{
+		CompactTree<int,std::string,decltype(&default_comparator<int>),true> split{};
+		for (auto k : shuffled)
+			REQUIRE(split.insert(k, std::to_string(k)).second == true);
+		REQUIRE(split.insert(7, "").second == false);
+		for (int i = 0; i < n; ++i)
+			REQUIRE(split[i] == std::to_string(i));
+		REQUIRE(split.find(n) == split.end());
+		int expected = 0;
+		for (const auto& e : split)
+			REQUIRE(e.second == std::to_string(expected++));
+		REQUIRE(expected == n);
+		split[n] = "last";
+		auto copy{split};
+		split.clear();
+		REQUIRE(split.begin() == split.end());
+		const auto& ccopy = copy;
+		REQUIRE(ccopy[n] == "last");
+		REQUIRE_THROWS_AS(ccopy[-1], const std::runtime_error&);
+		REQUIRE((*ccopy.find(42)).second == "42");
+	}
+	SECTION("Custom comparison function")
+	{
+		CompactTree<int,int,std::greater<int>> reversed{std::greater<int>{}};
+		for (auto k : shuffled)
+			reversed.insert(k, k);
+		REQUIRE((*reversed.begin()).first == n - 1);
+		REQUIRE((*(++reversed.begin())).first == n - 2);
+	}
+}
+
+TEST_CASE("Testing the frozen Eytzinger snapshot", "[FrozenTree]")
+{
+	SECTION("Every size of the implicit tree")
+	{
+		for (int n = 0; n < 70; ++n)
+		{
+			BinaryTree<int,int> bt{};
+			std::vector<int> keys;
+			for (int i = 0; i < n; ++i)
+				keys.push_back(2*i);
+			std::random_shuffle(keys.begin(), keys.end());
+			for (auto k : keys)
+				bt.insert(k, k + 1);
+			const FrozenTree<int,int> ft = bt.freeze();
+			REQUIRE(ft.size() == std::size_t(n));
+			for (int i = 0; i < n; ++i)
+			{
+				REQUIRE(ft[2*i] == 2*i + 1);
+				REQUIRE((*ft.find(2*i)).first == 2*i);
+				// the keys in between are missing
+				REQUIRE(ft.find(2*i + 1) == ft.end());
+			}
+			REQUIRE(ft.find(-1) == ft.end());
+			REQUIRE_THROWS_AS(ft[-1], const std::runtime_error&);
+			int expected = 0;
+			for (const auto& e : ft)
+			{
+				REQUIRE(e.first == expected);
+				expected += 2;
+			}
+			REQUIRE(expected == 2*n);
+		}
+	}
+	SECTION("Strings and custom comparison function")
+	{
+		BinaryTree<std::string,double> bt{};
+		BinaryTree<int,std::string,std::greater<int>> reversed{std::greater<int>{}};
+		for (int i = 0; i < 100; ++i)
+		{
+			bt.insert(std::to_string(i), i + 0.1);
+			reversed.insert(i, std::to_string(i));
+		}
+		auto ft = bt.freeze();
+		auto rft = reversed.freeze();
+		bt.clear();
+		REQUIRE(ft["42"] == 42.1);
+		REQUIRE(ft.find("baobab") == ft.end());
+		REQUIRE((*rft.begin()).first == 99);
+		REQUIRE((*(++rft.begin())).first == 98);
+		REQUIRE(rft[7] == "7");
+	}
+}
+
+TEST_CASE("Testing the van Emde Boas snapshot", "[VebTree]")
+{
+	SECTION("Every size up to six levels")
+	{
+		for (int n = 0; n < 70; ++n)
+		{
+			BinaryTree<int,int> bt{};
+			for (int i = 0; i < n; ++i)
+				bt.insert(2*i, 2*i + 1);
+			bt.balance();
+			const VebTree<int,int> vt{bt.begin(), bt.end()};
+			REQUIRE(vt.size() == std::size_t(n));
+			for (int i = 0; i < n; ++i)
+			{
+				REQUIRE(vt[2*i] == 2*i + 1);
+				REQUIRE((*vt.find(2*i)).first == 2*i);
+				REQUIRE(vt.find(2*i + 1) == vt.end());
+			}
+			REQUIRE(vt.find(-1) == vt.end());
+			REQUIRE_THROWS_AS(vt[-1], const std::runtime_error&);
+			int expected = 0;
+			for (const auto& e : vt)
+			{
+				REQUIRE(e.first == expected);
+				expected += 2;
+			}
+			REQUIRE(expected == 2*n);
+		}
+	}
+	SECTION("A deeper tree with strings and a custom comparison function")
+	{
+		BinaryTree<int,std::string,std::greater<int>> reversed{std::greater<int>{}};
+		BinaryTree<std::string,int> words{};
+		for (int i = 0; i < 3000; ++i)
+		{
+			reversed.insert(i, std::to_string(i));
+			words.insert(std::to_string(i), i);
+		}
+		VebTree<int,std::string,std::greater<int>> vt{reversed.cbegin(), reversed.cend(), std::greater<int>{}};
+		VebTree<std::string,int> wt{words.cbegin(), words.cend()};
+		for (int i = 0; i < 3000; ++i)
+		{
+			REQUIRE(vt[i] == std::to_string(i));
+			REQUIRE(wt[std::to_string(i)] == i);
+		}
+		REQUIRE((*vt.begin()).first == 2999);
+		REQUIRE(wt.find("baobab") == wt.end());
+	}
+}
+
+TEST_CASE("Testing the SIMD search index", "[STree]")
+{
+	SECTION("Integer keys, every size up to three levels")
+	{
+		REQUIRE((STree<int,int>::vectorized));
+		for (int n = 0; n < 600; n += (n < 40 ? 1 : 37))
+		{
+			BinaryTree<int,int> bt{};
+			for (int i = 0; i < n; ++i)
+				bt.insert(2*i, 2*i + 1);
+			const STree<int,int> st{bt.begin(), bt.end()};
+			REQUIRE(st.size() == std::size_t(n));
+			for (int i = 0; i < n; ++i)
+			{
+				REQUIRE(st[2*i] == 2*i + 1);
+				REQUIRE((*st.find(2*i)).first == 2*i);
+				REQUIRE(st.find(2*i + 1) == st.end());
+			}
+			REQUIRE(st.find(-1) == st.end());
+			REQUIRE_THROWS_AS(st[-1], const std::runtime_error&);
+			int expected = 0;
+			for (const auto& e : st)
+			{
+				REQUIRE(e.first == expected);
+				expected += 2;
+			}
+			REQUIRE(expected == 2*n);
+		}
+	}
+	SECTION("Floating point keys and the greatest value")
+	{
+		REQUIRE((STree<double,int>::vectorized));
+		REQUIRE((STree<float,int>::vectorized));
+		BinaryTree<double,int> bt{};
+		for (int i = 0; i < 1000; ++i)
+			bt.insert(i*0.5, i);
+		bt.insert(std::numeric_limits<double>::max(), -1);
+		const STree<double,int> st{bt.cbegin(), bt.cend()};
+		for (int i = 0; i < 1000; ++i)
+			REQUIRE(st[i*0.5] == i);
+		REQUIRE(st.find(0.25) == st.end());
+		REQUIRE(st[std::numeric_limits<double>::max()] == -1);
+		REQUIRE(st.find(std::numeric_limits<double>::infinity()) == st.end());
+
+		BinaryTree<long,int> lt{};
+		for (long i = 0; i < 1000; ++i)
+			lt.insert(i, int(i));
+		const STree<long,int> sl{lt.cbegin(), lt.cend()};
+		REQUIRE(sl[999] == 999);
+		REQUIRE(sl.find(1000) == sl.end());
+	}
+	SECTION("Strings and custom comparison functions fall back to the scalar tree")
+	{
+		REQUIRE_FALSE((STree<std::string,int>::vectorized));
+		REQUIRE_FALSE((STree<int,int,std::greater<int>>::vectorized));
+		BinaryTree<std::string,int> words{};
+		for (int i = 0; i < 300; ++i)
+			words.insert(std::to_string(i), i);
+		const STree<std::string,int> st{words.cbegin(), words.cend()};
+		for (int i = 0; i < 300; ++i)
+			REQUIRE(st[std::to_string(i)] == i);
+		REQUIRE(st.find("baobab") == st.end());
+
+		BinaryTree<int,int> bt{};
+		bt.insert(1, 1);
+		REQUIRE_THROWS_AS((STree<int,int,decltype(&default_comparator<int>)>{bt.cbegin(), bt.cend(), [](const int& a, const int& b) {return a > b;}}), const std::invalid_argument&);
+	}
+}
+
+TEST_CASE("Testing the batched lookups", "[find_batch]")
+{
+	// the result of every key must be the one of find(), whatever the size of the tree and of the last group
+	auto same_as_find = [](auto&& tree, const std::vector<int>& keys)
+	{
+		std::vector<decltype(tree.find(0))> results;
+		auto end = tree.find_batch(keys, std::back_inserter(results));
+		(void)end;
+		REQUIRE(results.size() == keys.size());
+		for (std::size_t i = 0; i < keys.size(); ++i)
+			REQUIRE((results[i] == tree.find(keys[i])));
+	};
+	SECTION("Every layout, with present and missing keys")
+	{
+		for (int n = 0; n < 70; ++n)
+		{
+			BinaryTree<int,int> bt{};
+			std::vector<int> keys;
+			for (int i = 0; i < n; ++i)
+				keys.push_back(2*i);
+			std::random_shuffle(keys.begin(), keys.end());
+			for (auto k : keys)
+				bt.insert(k, k + 1);
+			// all the keys in between and around, in random order
+			std::vector<int> searched;
+			for (int i = -1; i <= 2*n; ++i)
+				searched.push_back(i);
+			std::random_shuffle(searched.begin(), searched.end());
+			same_as_find(bt, searched);
+			same_as_find(bt.freeze(), searched);
+			same_as_find(VebTree<int,int>{bt.cbegin(), bt.cend()}, searched);
+			same_as_find(STree<int,int>{bt.cbegin(), bt.cend()}, searched);
+		}
+	}
+	SECTION("The iterators of a modifiable tree")
+	{
+		BinaryTree<int,int,default_less<int>,balancing::splay> bt{};
+		for (int i = 0; i < 100; ++i)
+			bt.insert((i*37) % 100, i);
+		const std::vector<int> keys{37, 100, 0, 99, -5, 74};
+		std::vector<BinaryTree<int,int,default_less<int>,balancing::splay>::Iterator> found(keys.size(), bt.end());
+		REQUIRE(bt.find_batch(keys, found.begin()) == found.end());
+		REQUIRE((*found[0]).second == 1);
+		REQUIRE(found[1] == bt.end());
+		REQUIRE(found[4] == bt.end());
+		(*found[5]).second = -1;
+		REQUIRE(bt[74] == -1);
+		REQUIRE(bt.find_batch(std::vector<int>{}, found.begin()) == found.begin());
+		const auto& cbt = bt;
+		std::vector<BinaryTree<int,int,default_less<int>,balancing::splay>::ConstIterator> constant;
+		cbt.find_batch(keys, std::back_inserter(constant));
+		REQUIRE((*constant[3]).first == 99);
+		REQUIRE(constant[4] == cbt.end());
+	}
+	SECTION("Strings through the scalar layouts")
+	{
+		BinaryTree<std::string,int> bt{};
+		for (int i = 0; i < 300; ++i)
+			bt.insert(std::to_string(i), i);
+		const STree<std::string,int> st{bt.cbegin(), bt.cend()};
+		const VebTree<std::string,int> vt{bt.cbegin(), bt.cend()};
+		const std::vector<std::string> keys{"42", "baobab", "299", "0", "300"};
+		std::vector<STree<std::string,int>::ConstIterator> in_s;
+		std::vector<VebTree<std::string,int>::ConstIterator> in_v;
+		st.find_batch(keys, std::back_inserter(in_s));
+		vt.find_batch(keys, std::back_inserter(in_v));
+		REQUIRE((*in_s[0]).second == 42);
+		REQUIRE(in_s[1] == st.end());
+		REQUIRE((*in_v[2]).second == 299);
+		REQUIRE(in_v[4] == vt.end());
+	}
+}
+
+// a coroutine of the caller, that writes its name at every step
+interleave::task steps(std::string& log, char name, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		log += name;
+		co_await std::suspend_always{};
+	}
+}
+
+interleave::task failing()
+{
+	co_await std::suspend_always{};
+	throw std::runtime_error("the coroutine failed");
+}
+
+TEST_CASE("Testing the interleaved lookups", "[interleave]")
+{
+	SECTION("The coroutines find the same nodes as find()")
+	{
+		BinaryTree<int,int,default_less<int>,balancing::red_black> bt{};
+		for (int i = 0; i < 1000; ++i)
+			bt.insert((i*37) % 1000 * 2, i);
+		for (std::size_t width : {1, 3, 16})
+		{
+			interleave::scheduler lookups{width};
+			REQUIRE(lookups.width() == width);
+			std::vector<BinaryTree<int,int,default_less<int>,balancing::red_black>::Iterator> found(2002, bt.end());
+			for (int k = -1; k <= 2000; ++k)
+				lookups.spawn(bt.co_find(k, &found[std::size_t(k + 1)]));
+			REQUIRE(lookups.size() <= width);
+			lookups.run();
+			REQUIRE(lookups.size() == 0);
+			for (int k = -1; k <= 2000; ++k)
+				REQUIRE((found[std::size_t(k + 1)] == bt.find(k)));
+		}
+		const auto& cbt = bt;
+		BinaryTree<int,int,default_less<int>,balancing::red_black>::ConstIterator in_constant = cbt.end();
+		interleave::scheduler single{};
+		single.spawn(cbt.co_find(74, &in_constant));
+		single.run();
+		REQUIRE((*in_constant).second == 1);
+
+		BinaryTree<int,int> empty{};
+		BinaryTree<int,int>::Iterator nothing = empty.begin();
+		single.spawn(empty.co_find(1, &nothing));
+		single.run();
+		REQUIRE(nothing == empty.end());
+	}
+	SECTION("The tasks of the caller are run in round-robin with the lookups")
+	{
+		std::string log;
+		interleave::scheduler mixed{3};
+		mixed.spawn(steps(log, 'a', 3));
+		mixed.spawn(steps(log, 'b', 1));
+		mixed.spawn(steps(log, 'c', 2));
+		REQUIRE(log.empty());
+		// the fourth task waits for one of the three to finish
+		mixed.spawn(steps(log, 'd', 2));
+		REQUIRE(log == "abca");
+		mixed.run();
+		REQUIRE(log == "abcacdad");
+		mixed.spawn(interleave::task{});
+		REQUIRE(mixed.size() == 0);
+	}
+	SECTION("An exception of a task is thrown by the scheduler")
+	{
+		std::string log;
+		interleave::scheduler throwing{2};
+		throwing.spawn(failing());
+		throwing.spawn(steps(log, 'a', 3));
+		REQUIRE_THROWS_AS(throwing.run(), const std::runtime_error&);
+		// the other task is still there
+		REQUIRE(throwing.size() == 1);
+		throwing.run();
+		REQUIRE(log == "aaa");
+	}
+}